@@ -9,11 +9,12 @@
 #include "context.h"
 #include "supported_gates.h"
 #include "ast_utils.h"
+#include "ast_index.h"
 
 class Ast{
     public:
-        Ast(const Control& _control) :
-            context(_control),
+        Ast(const Control& _control, int ast_id) :
+            context(_control, ast_id),
             control(_control)
         {
             context.reset(RL_PROGRAM);
@@ -25,6 +26,7 @@ class Ast{
             control(_context.get_control())
         {
             context.change_nested_depth(manual_nested_depth);
+            context.start_budget();
             context.reset(RL_QUBITS);
             context.reset(RL_BITS);
         }
@@ -56,7 +58,9 @@ struct Ast_entry {
     public:
         Ast_entry(){}
 
-        Ast_entry(std::shared_ptr<Node> _ast, std::shared_ptr<Context> _context) :
+        /// `arena` is the one the nodes of `ast` and `context` were allocated from, if any, which the entry keeps alive
+        Ast_entry(std::shared_ptr<Node> _ast, std::shared_ptr<Context> _context, std::shared_ptr<Arena> _arena = nullptr) :
+            arena(_arena),
             ast(_ast),
             context(_context)
         {
@@ -64,26 +68,37 @@ struct Ast_entry {
                 ERROR("Cannot pass NULL as AST to entry");
             }
 
-            comp_unit = get_compilation_unit(ast);
-            find_qubit_ops();
+            index = std::make_shared<Ast_index>(*ast);
+            comp_unit = get_compilation_unit(*index);
         }
 
-        void find_qubit_ops(){
-            auto _find_qubit_ops = [](Node& root, std::vector<std::shared_ptr<Qubit_op>>& out){
-                for (const auto& node : Node_gen(root, QUBIT_OP)){                
-                    auto qubit_op = static_pointer_cast<Qubit_op>(node);
-                    out.push_back(qubit_op);
-                }
-            };
+        Ast_entry(const Ast_entry&) = default;
 
-            _find_qubit_ops(*ast, ast_qubit_ops);
-            _find_qubit_ops(*comp_unit, comp_unit_qubit_ops);
+        Ast_entry(Ast_entry&&) = default;
+
+        /// swaps with a copy rather than assigning member by member, so that the AST replaced is destroyed before its arena is released
+        Ast_entry& operator=(Ast_entry other){
+            std::swap(arena, other.arena);
+            std::swap(ast, other.ast);
+            std::swap(comp_unit, other.comp_unit);
+            std::swap(context, other.context);
+            std::swap(index, other.index);
+
+            return *this;
         }
 
         /// return a clone of this ast entry, by deep cloning the AST, effectively creating a new one, then getting the new compilation unit ptr from that
-        Ast_entry clone() {
-            std::shared_ptr<Node> new_ast = ast->clone(DEEP);
-            return Ast_entry{new_ast, context};
+        /// the clone gets its own arena, sized from the bytes still live in this one with a quarter on top, so that the copy and the mutation
+        /// that usually follows land in a single buffer (most mutations add a few percent), and a copy of the context pointing at the cloned
+        /// nodes. The clone shares no node with this entry, so neither keeps the other's arena alive
+        Ast_entry clone() const {
+            auto new_arena = std::make_shared<Arena>(arena ? arena->get_bytes_live() * 5 / 4 : Arena::DEFAULT_INITIAL_SIZE);
+            Arena::Scope scope(new_arena);
+
+            Clone_map copies;
+            std::shared_ptr<Node> new_ast = ast->clone(copies);
+
+            return Ast_entry{new_ast, context->fork(copies), new_arena};
         }
 
         bool empty() const {return (ast == nullptr);}
@@ -100,20 +115,37 @@ struct Ast_entry {
 
         // Qubit ops of entire AST or compilation unit
         std::vector<std::shared_ptr<Qubit_op>> get_qubit_ops(bool consider_entire_ast) const {
-            return consider_entire_ast ? ast_qubit_ops : comp_unit_qubit_ops;
+            std::vector<std::shared_ptr<Qubit_op>> out;
+
+            for (const auto& node : index->collect(QUBIT_OP, consider_entire_ast ? nullptr : comp_unit.get())){
+                out.push_back(static_pointer_cast<Qubit_op>(node));
+            }
+
+            return out;
+        }
+
+        /// kind index of the AST, shared by copies of this entry since they share the tree
+        std::shared_ptr<Ast_index> get_index() const {
+            return index;
         }
 
         std::shared_ptr<Context> get_context() const {
             return context;
         }
 
+        /// arena owning the nodes of this AST, nodes added by mutations should be allocated from it too
+        std::shared_ptr<Arena> get_arena() const {
+            return arena;
+        }
+
     private:
+        // declared first so that it is released last, once the nodes allocated from it are gone
+        std::shared_ptr<Arena> arena;
+
         std::shared_ptr<Node> ast = nullptr;
         std::shared_ptr<Node> comp_unit;
         std::shared_ptr<Context> context;
-
-        std::vector<std::shared_ptr<Qubit_op>> comp_unit_qubit_ops;
-        std::vector<std::shared_ptr<Qubit_op>> ast_qubit_ops;
+        std::shared_ptr<Ast_index> index;
 
 };
 
@@ -7,6 +7,7 @@
 #include <compound_stmt.h>
 #include <gate.h>
 #include <node_gen.h>
+#include <chrono>
 
 
 enum Reset_level {
@@ -26,10 +27,18 @@ struct Current_nodes {
 		}
 
 		void reset_all() {
-			resource_def = std::make_shared<Resource_def>();
-			resource = std::make_shared<Resource>();
-			gate = std::make_shared<Gate>();
-			qubit_op = std::make_shared<Qubit_op>("");
+			resource_def = make_node<Resource_def>();
+			resource = make_node<Resource>();
+			gate = make_node<Gate>();
+			qubit_op = make_node<Qubit_op>("");
+		}
+
+		/// point at the copies made by a clone. Building a gate sets the gate of the current qubit op, so that one gets a private copy on top
+		void relink(Clone_map& copies){
+			resource_def = relinked(resource_def, copies);
+			resource = relinked(resource, copies);
+			gate = relinked(gate, copies);
+			qubit_op = make_node<Qubit_op>(*relinked(qubit_op, copies));
 		}
 
 		template<typename T>
@@ -74,12 +83,18 @@ struct Context {
 	static int ast_counter;
 
 	public:
-		Context(const Control& _control) :
-			control(_control)
-
+		Context(const Control& _control, int _ast_id) :
+			control(_control),
+			ast_id(_ast_id)
 		{
-			ast_counter += 1;
-			nested_depth = control.get_value("NESTED_MAX_DEPTH");
+			nested_depth = control.resolved.nested_max_depth;
+		}
+
+		/// Reserve IDs for `n` new ASTs up front, so that ASTs built on different threads get the same IDs as a serial run
+		static int reserve_ast_ids(unsigned int n){
+			int first_id = ast_counter + 1;
+			ast_counter += n;
+			return first_id;
 		}
 
 		void change_nested_depth(unsigned int new_depth){
@@ -92,14 +107,38 @@ struct Context {
 
 		void reset(Reset_level l);
 
+		/// start the node, byte and time budgets of a build afresh
+		void start_budget();
+
+		/// count a node added to the AST, with the bytes of syntax it writes out, against the budgets set by `MAX_AST_NODES`,
+		/// `MAX_AST_BYTES` and `MAX_AST_MILLIS`
+		void charge_node(size_t n_bytes);
+
+		/// once any budget is spent, the rest of the AST is built from the cheapest branch of each rule so that it finishes soon
+		inline bool over_budget() const { return budget_spent; }
+
+		/// Copy of this context for a clone of its AST, pointing at the copies recorded in `copies` instead of the nodes of the source AST.
+		/// Nodes the clone didn't copy, such as resources and defs stored in circuits, are copied too, so the copy shares no node with this
+		std::shared_ptr<Context> fork(Clone_map& copies) const;
+
 		bool can_apply_as_subroutine(const std::shared_ptr<Circuit> circuit);
 
 		bool current_circuit_uses_subroutines();
 
+		/// circuits or their resource defs changed, so which circuits can be applied as subroutines must be worked out again
+		inline void invalidate_applicable_subroutines(){
+			applicable_subroutines_valid = false;
+		}
+
 		const Control& get_control() const { return control; }
 
 		Expr_type resolve_var(const Token_kind name, const std::vector<Expr_type>& args) const;
 
+		/// variables that evaluate to an int, bool or float whenever their arguments do, see `resolve_scalar_var`
+		static bool is_scalar_var(const Token_kind name);
+
+		Scalar resolve_scalar_var(const Token_kind name, const Scalar* args, size_t n_args) const;
+
 		std::shared_ptr<Circuit> get_current_circuit() const;
 
 		std::shared_ptr<Circuit> get_random_circuit();
@@ -125,7 +164,7 @@ struct Context {
 		std::shared_ptr<Gate> nn_subroutine_op();
 
 		template<typename T>
-		Ptr_coll<T> get_current_coll(Resource_kind rk) const {
+		std::span<const std::shared_ptr<T>> get_current_coll(Resource_kind rk) const {
 			return get_current_circuit()->get_coll<T>(rk);
 		}
 
@@ -145,6 +184,17 @@ struct Context {
 			}
 		}
 
+		/// bind `var` to `rule` in place of whatever it was bound to, so that repeated assignments to the same name do not pile up
+		inline void rebind_rule(const std::string& var, std::shared_ptr<Rule> rule){
+			Ptr_coll<Rule>& bound = rule_bindings[var];
+
+			if (bound.empty()){
+				bound.push_back(rule);
+			} else {
+				bound.back() = rule;
+			}
+		}
+
 		void pop_var(const std::string& var){
 			if (resource_var_bindings.find(var) != resource_var_bindings.end()){
 				resource_var_bindings[var].pop_back();
@@ -211,15 +261,30 @@ struct Context {
 		std::unordered_map<std::string, Ptr_coll<Rule>> rule_bindings;
 
 		std::vector<std::shared_ptr<Circuit>> circuits;
-		std::shared_ptr<Circuit> dummy_circuit = std::make_shared<Circuit>();
+		std::shared_ptr<Circuit> dummy_circuit = make_node<Circuit>();
 
         std::unordered_map<Resource_kind, unsigned int> total_times_used;
 
+		int ast_id;
 		unsigned int subroutine_counter = 0;
+		unsigned int next_resource_id = 1;
 		unsigned int current_port = 0;
 		unsigned int nested_depth;
 
 		std::shared_ptr<Node> subroutine_defs_node = nullptr;
+
+		/// whether `circuits[i]` can be applied as a subroutine from `applicable_subroutines_for`, see `update_applicable_subroutines`
+		std::vector<bool> applicable_subroutines;
+		unsigned int n_applicable_subroutines = 0;
+		const Circuit* applicable_subroutines_for = nullptr;
+		bool applicable_subroutines_valid = false;
+
+		void update_applicable_subroutines();
+
+		unsigned int budget_nodes = 0;
+		size_t budget_bytes = 0;
+		std::chrono::steady_clock::time_point budget_start;
+		bool budget_spent = false;
 };
 
 
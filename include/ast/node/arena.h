@@ -0,0 +1,123 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
+
+/*
+    Bump allocator backing the nodes of one AST. Nodes (together with their shared_ptr control blocks and child arrays) are carved
+    out of a few large buffers instead of thousands of small heap allocations, and the buffers are released in one go once the
+    last node allocated from the arena dies. Deallocating a single node only counts its bytes as no longer live.
+
+    The arena is not thread safe: only one thread may allocate from it at a time, which holds since each AST is built or mutated
+    by a single thread.
+
+    Nodes don't keep their arena alive, the `Ast_entry` owning the AST does. So nodes allocated from an arena, and the child arrays
+    they hold, must not outlive every `Ast_entry` keeping it alive, and nodes of one arena must not point at nodes of another.
+*/
+class Arena final : public std::pmr::memory_resource {
+
+    public:
+        static constexpr size_t DEFAULT_INITIAL_SIZE = 64 * 1024;
+
+        Arena(size_t initial_size = DEFAULT_INITIAL_SIZE) :
+            pool(std::max(initial_size, size_t(1)))
+        {}
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        /// bytes held by nodes and child arrays that are still alive, which is what a copy of them takes. Freed bytes are not
+        /// reused, so the arena itself may hold a lot more once an AST has been mutated
+        inline size_t get_bytes_live() const {
+            return bytes_live;
+        }
+
+        /// arena that `make_node` allocates from on this thread, or nullptr to fall back to the heap
+        static inline Arena* current(){
+            return current_arena.get();
+        }
+
+        /// memory resource for child arrays of nodes created on this thread
+        static inline std::pmr::memory_resource* current_resource(){
+            return current_arena ? static_cast<std::pmr::memory_resource*>(current_arena.get()) : std::pmr::new_delete_resource();
+        }
+
+        /// @brief Routes all node allocations made by this thread into `arena` for the lifetime of the scope
+        class Scope {
+            public:
+                Scope(std::shared_ptr<Arena> arena) :
+                    prev(std::move(current_arena))
+                {
+                    current_arena = std::move(arena);
+                }
+
+                Scope(const Scope&) = delete;
+                Scope& operator=(const Scope&) = delete;
+
+                ~Scope(){
+                    current_arena = std::move(prev);
+                }
+
+            private:
+                std::shared_ptr<Arena> prev;
+        };
+
+    private:
+        std::pmr::monotonic_buffer_resource pool;
+        size_t bytes_live = 0;
+
+        inline void* do_allocate(size_t bytes, size_t alignment) override {
+            bytes_live += bytes;
+            return pool.allocate(bytes, alignment);
+        }
+
+        /// only counted, the pool releases memory all at once
+        inline void do_deallocate(void*, size_t bytes, size_t) override {
+            bytes_live -= bytes;
+        }
+
+        inline bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+            return this == &other;
+        }
+
+        static inline thread_local std::shared_ptr<Arena> current_arena = nullptr;
+};
+
+/// @brief Allocator handed to `std::allocate_shared`. It holds a plain pointer, so creating and dropping a node costs no reference counting
+/// on the arena, which the owner of the AST keeps alive instead
+template<typename T>
+struct Arena_allocator {
+    using value_type = T;
+
+    Arena_allocator(Arena* _arena) : arena(_arena) {}
+
+    template<typename U>
+    Arena_allocator(const Arena_allocator<U>& other) : arena(other.arena) {}
+
+    inline T* allocate(size_t n){
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    inline void deallocate(T* p, size_t n){
+        arena->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    template<typename U>
+    bool operator==(const Arena_allocator<U>& other) const { return arena == other.arena; }
+
+    Arena* arena;
+};
+
+/// @brief Create a node in the current thread's arena, or on the heap if no arena is in scope
+template<typename T, typename... Args>
+inline std::shared_ptr<T> make_node(Args&&... args){
+    if (Arena* arena = Arena::current()){
+        return std::allocate_shared<T>(Arena_allocator<T>(arena), std::forward<Args>(args)...);
+    }
+
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
+
+#endif
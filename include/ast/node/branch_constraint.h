@@ -14,7 +14,11 @@ struct Branch_constraint {
             n_occurances(_n_occurances)
         {}
 
-        inline bool passed(const Branch& branch){
+        inline Token_kind get_kind() const { return singleton_term_token_kind; }
+
+        inline unsigned int get_n_occurances() const { return n_occurances; }
+
+        inline bool passed(const Branch& branch) const {
             return branch.count_rule_occurances(singleton_term_token_kind) == n_occurances;
         }
 
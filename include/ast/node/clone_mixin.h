@@ -12,16 +12,11 @@ template<typename Derived, typename Base = Node>
 struct Cloneable : Base {
     using Base::Base;
 
-    std::shared_ptr<Node> clone(const Clone_type& ct) const override {
-        auto copy = std::make_shared<Derived>(static_cast<const Derived&>(*this));
+    std::shared_ptr<Node> shallow_copy() const override {
+        auto copy = make_node<Derived>(static_cast<const Derived&>(*this));
         copy->children.clear();
         copy->incr_id();
 
-        if (ct == DEEP){
-            for (const auto& child : Base::children)
-                copy->children.push_back(child->clone(ct));
-        }
-
         return copy;
     }
 };
@@ -5,6 +5,7 @@
 #include <lex.h>
 #include <branch_constraint.h>
 #include <rule.h>
+#include <arena.h>
 
 // class UInt;
 // class Variable;
@@ -14,12 +15,19 @@ class Node;
 
 using Slot_type = std::shared_ptr<Node>*;
 
+/// child arrays are allocated from the arena of the AST being built, next to the nodes themselves. They hold a plain pointer to the
+/// arena's memory resource, which is valid for as long as the node is, see `Arena`
+using Node_children = std::pmr::vector<std::shared_ptr<Node>>;
+
+/// nodes of a tree being cloned, and the copies made of them, see `Node::clone`
+using Clone_map = std::unordered_map<const Node*, std::shared_ptr<Node>>;
+
 
 /// @brief A node is a term with pointers to other nodes
 class Node : public std::enable_shared_from_this<Node> {
 
     public:
-        static int node_counter;
+        static thread_local int node_counter;
         Print_mode print_mode = Print_mode::DEFAULT;
 
         Node(){}
@@ -38,19 +46,44 @@ class Node : public std::enable_shared_from_this<Node> {
             id = node_counter++;
         }
 
-        Node(const Node& other) = default;
-
-        virtual ~Node() = default;
+        /// copies are placed in the current arena, so the child array is re-allocated there rather than sharing the source's resource.
+        /// The copy is detached, it gets a parent once added to one
+        Node(const Node& other) :
+            enable_shared_from_this(other),
+            print_mode(other.print_mode),
+            id(other.id),
+            str(other.str),
+            kind(other.kind),
+            children(other.children, Arena::current_resource()),
+            state(other.state),
+            branch_constraint(other.branch_constraint)
+        {}
+
+        /// releases deep subtrees from a single loop rather than one nested destructor call per level, see node.cpp
+        virtual ~Node();
 
         inline virtual std::string resolved_name() const {
             return get_str();
         }
 
         inline Slot_type add_child(const std::shared_ptr<Node> child){
+            child->parent = weak_from_this();
+            child->index_in_parent = children.size();
             children.push_back(child);
             return &children.back();
         }
 
+        /// node this one was last attached to. It may no longer hold this node if it was replaced since
+        inline std::shared_ptr<Node> get_parent() const {
+            return parent.lock();
+        }
+
+        /// take over the parent link of `other`, for a node that is about to be written into `other`'s slot
+        inline void take_parent_of(const Node& other){
+            parent = other.parent;
+            index_in_parent = other.index_in_parent;
+        }
+
         inline void transition_to_done(){
             state = NB_DONE;
         }
@@ -79,7 +112,7 @@ class Node : public std::enable_shared_from_this<Node> {
             kind = _kind;
         }
 
-        inline std::vector<std::shared_ptr<Node>>& get_children() {
+        inline Node_children& get_children() {
             return children;
         }
 
@@ -97,13 +130,17 @@ class Node : public std::enable_shared_from_this<Node> {
 
         inline void insert_child(size_t index, Node& child) {
             if(index < size()){
-                children.insert(children.begin() + index, std::make_shared<Node>(child));
+                auto new_child = make_node<Node>(child);
+                new_child->parent = weak_from_this();
+                children.insert(children.begin() + index, new_child);
+                reindex_children(index);
             }
         }
 
         inline void erase_child(size_t index) {
             if(index < size()){
                 children.erase(children.begin() + index);
+                reindex_children(index);
             }
         }
 
@@ -131,6 +168,10 @@ class Node : public std::enable_shared_from_this<Node> {
             return branch_constraint.has_value();
         }
 
+        inline const std::optional<Branch_constraint>& get_branch_constraint() const {
+            return branch_constraint;
+        }
+
         inline void print_branch_constraint(std::ostream& stream){
             if(branch_constraint.has_value()){
                 stream << branch_constraint.value() << std::endl;
@@ -145,20 +186,46 @@ class Node : public std::enable_shared_from_this<Node> {
 
         virtual unsigned int get_n_ports() const;
 
-        virtual std::shared_ptr<Node> clone(const Clone_type& ct) const;
+        /// copy of this node, and with DEEP of every node below it. Subtrees are copied with an explicit stack, so deep trees clone safely
+        std::shared_ptr<Node> clone(const Clone_type& ct) const;
+
+        /// deep copy of this node that shares nothing with it. Copies of linkable nodes are recorded in `copies`, then every copy is made to
+        /// point at the copies of the nodes it links to (the gate of a qubit op, the defs of a gate or circuit ...), see `relinked`
+        std::shared_ptr<Node> clone(Clone_map& copies) const;
+
+        /// copy of this node alone, with no children, of the same dynamic type
+        virtual std::shared_ptr<Node> shallow_copy() const;
+
+        /// point the links this copy took over from its source at the copies in `copies`, see `relinked`
+        virtual void relink(Clone_map&) {}
+
+        /// whether other nodes or the context may link to this node, only such nodes have their copies recorded by a clone
+        inline virtual bool linkable() const {
+            return kind == SUBROUTINE_DEFS;
+        }
+
+        /// write the program below this node to `stream` in one go
+        void print_program(std::ostream& stream) const;
 
-        virtual void print_program(std::ostream& stream, unsigned int indent_level = 0) const;
+        /// append the program below this node to `out`. The tree is walked with an explicit stack, so any depth the builder allows can be written
+        void write_program(std::string& out, unsigned int indent_level = 0) const;
 
-        bool visited(std::vector<Slot_type>& visited_slots, Slot_type slot, bool track_visited) const ;
+        /// append what comes before this node's children, returning whether the children are written at all
+        virtual bool write_head(std::string& out, unsigned int indent_level) const;
 
-        Slot_type find_slot(Token_kind node_kind, std::vector<Slot_type>& visited_slots, bool track_visited = true);
+        /// append what comes after each of this node's children
+        virtual void write_child_suffix(std::string&) const {}
+
+        Slot_type find_slot(Token_kind node_kind);
 
         std::shared_ptr<Node> find(Token_kind node_kind);
 
-        Slot_type find_slot(std::string node_name, std::vector<Slot_type>& visited_slots, bool track_visited = true);
+        Slot_type find_slot(const std::string& node_name);
 
         std::shared_ptr<Node> find(std::string node_name);
 
+        Slot_type slot_of_child(const Node* child);
+
         void print_ast(std::string indent) const;
 
         void extend_dot_string(std::ostringstream& ss) const;
@@ -176,11 +243,41 @@ class Node : public std::enable_shared_from_this<Node> {
         std::string str;
         Token_kind kind = H;
 
-        std::vector<std::shared_ptr<Node>> children;
+        Node_children children{Arena::current_resource()};
         Node_build_state state = NB_BUILD;
 
     private:
         std::optional<Branch_constraint> branch_constraint;
+
+        std::weak_ptr<Node> parent;
+        size_t index_in_parent = 0; // hint, checked before use since siblings may have moved
+
+        /// copy of this node and every node below it. If given, `copies` records the copy of this node and those of linkable nodes below it,
+        /// and `made` collects the copies of the nodes below it
+        std::shared_ptr<Node> copy_tree(Clone_map* copies, std::vector<Node*>* made) const;
+
+        /// slot of the first node below this one satisfying `pred`, in pre-order
+        template<typename Pred>
+        Slot_type find_slot_if(Pred pred);
+
+        inline void reindex_children(size_t from){
+            for (size_t i = from; i < children.size(); i++){
+                children[i]->index_in_parent = i;
+            }
+        }
 };
 
+/// copy of `node` recorded in `copies`, or a new clone of it if none was, such as for nodes outside the tree cloned
+template<typename T>
+inline std::shared_ptr<T> relinked(const std::shared_ptr<T>& node, Clone_map& copies){
+    if (node == nullptr){
+        return nullptr;
+    }
+
+    auto it = copies.find(node.get());
+    std::shared_ptr<Node> copy = (it == copies.end()) ? node->clone(copies) : it->second;
+
+    return std::static_pointer_cast<T>(copy);
+}
+
 #endif
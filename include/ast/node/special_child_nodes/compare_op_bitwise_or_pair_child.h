@@ -16,13 +16,13 @@ class Compare_op_bitwise_or_pair_child : public Node {
             Node(str, kind)
         {}
 
-        void print_program(std::ostream& stream, unsigned int indent_depth) const override {
-            stream << " ";
+        bool write_head(std::string& out, unsigned int) const override {
+            out += ' ';
+            return true;
+        }
 
-            for(const std::shared_ptr<Node>& child : children){
-                child->print_program(stream, indent_depth);
-                stream << " ";
-            }
+        void write_child_suffix(std::string& out) const override {
+            out += ' ';
         }
 
     private:
@@ -8,9 +8,9 @@
 #include <run_utils.h>
 #include <clone_mixin.h>
 #include <complex>
+#include <span>
 
-using Cx     = std::complex<double>;
-using CxMat  = std::vector<std::vector<Cx>>;
+using Cx = std::complex<double>;
 
 class Circuit : public Cloneable<Circuit> {
     public:
@@ -27,43 +27,69 @@ class Circuit : public Cloneable<Circuit> {
 
         inline bool check_if_sub_circuit(){return kind == SUB_CIRCUIT;}
 
+        /// all resource defs, in the order they were stored
+        inline const Ptr_coll<Resource_def>& get_resource_defs() const {
+            return resource_defs;
+        }
+
+        /// @brief Resources or resource defs of kind `rk`, in the order they were stored. The span is invalidated by storing another def
         template <typename T>
-        inline Ptr_coll<T> get_coll() const {
+        inline std::span<const std::shared_ptr<T>> get_coll(Resource_kind rk) const {
             if constexpr (std::is_same_v<T, Resource>) {
-                return resources;
+                return resources[(size_t)rk];
 
             } else if constexpr (std::is_same_v<T, Resource_def>) {
-                return resource_defs;
+                return resource_defs_by_kind[(size_t)rk];
 
             } else {
                 throw std::runtime_error("Unknown collection type in circuit");
             }
         }
 
-        template <typename T>
-        inline Ptr_coll<T> get_coll(Resource_kind rk) const {
-            auto pred = [rk](const auto& elem){ return elem->get_resource_kind() == rk; };
-            return filter<T>(get_coll<T>(), pred);
+        /// number of resources of kind `rk` with scope `scope`, which must be one of EXT, GLOB or INT
+        inline unsigned int get_n_resources(Resource_kind rk, Scope scope) const {
+            return n_scoped_resources[(size_t)rk][Resolved_control::scope_index(scope)];
         }
 
-        void store_resource_def(std::shared_ptr<Resource_def> def){
+        /// store resources of `def`, giving each the next dense resource id of the AST
+        void store_resource_def(std::shared_ptr<Resource_def> def, unsigned int& next_resource_id){
             std::string name = def->get_var_name();
             Scope scope = def->get_scope();
             Resource_kind rk = def->get_resource_kind();
 
+            Resource_pool& pool = pools[(size_t)rk];
+            n_scoped_resources[(size_t)rk][Resolved_control::scope_index(scope)] += def->get_size();
+
             for(size_t i = 0; i < def->get_size(); i++){
-                resources.push_back(std::make_shared<Resource>(name, i, scope, rk, def->is_reg()));
+                auto resource = make_node<Resource>(name, i, scope, rk, def->is_reg());
+                resource->set_resource_id(next_resource_id++);
+                resources[(size_t)rk].push_back(resource);
+
+                // new resources are unused
+                pool.order.push_back(resource);
+                std::swap(pool.order[pool.n_unused], pool.order.back());
+                pool.n_unused++;
             }
 
             resource_defs.push_back(def);
+            resource_defs_by_kind[(size_t)rk].push_back(def);
         }
 
+        /// mark every resource of kind `rk` as unused again
         inline void reset(Resource_kind rk){
-            for (const auto& elem : resources){
-                if(elem->get_resource_kind() == rk){
-                    elem->reset();
-                }
-            }
+            Resource_pool& pool = pools[(size_t)rk];
+            pool.n_unused = pool.order.size();
+        }
+
+        /// @brief Pick an unused resource of kind `rk` and mark it as used. Resources used less often are more likely to be picked, given
+        /// `total_times_used`, the number of picks of this kind so far. A dummy resource is returned if all are used
+        std::shared_ptr<Resource> use_random_resource(Resource_kind rk, unsigned int total_times_used);
+
+        /// the copy owns copies of the resources and defs too, so usage tracking on it doesn't touch the source circuit
+        void relink(Clone_map& copies) override;
+
+        inline bool linkable() const override {
+            return true;
         }
 
         inline unsigned int get_n_matrix_qubits() const{ return n_matrix_qubits; }
@@ -73,12 +99,32 @@ class Circuit : public Cloneable<Circuit> {
         void print_info() const;
 
     private:
+        /*
+            Resources of one kind, ordered so that the unused ones come first. Using one swaps it to the end of the unused part, and
+            marking them all unused again, which happens at every gate, only moves the boundary back
+        */
+        struct Resource_pool {
+            Ptr_coll<Resource> order;
+            size_t n_unused = 0;
+        };
+
         std::string name;
-        Ptr_coll<Resource> resources;
+
+        // everything below is kept per resource kind, indexed by `Resource_kind`, so that lookups never filter
+        std::array<Ptr_coll<Resource>, 3> resources;
+        std::array<Resource_pool, 3> pools;
+        std::array<std::array<unsigned int, 3>, 3> n_scoped_resources = {};
+        std::array<Ptr_coll<Resource_def>, 3> resource_defs_by_kind;
+
         Ptr_coll<Resource_def> resource_defs;
+        static constexpr unsigned int MAX_MATRIX_DIM = 4;
+
         unsigned int n_matrix_qubits = 0;
         unsigned int dim = 0;
-        CxMat        matrix;
+
+        /// entries of the unitary, row-major, each formatted as "re, im". Entry i is matrix_entries[offsets[i], offsets[i + 1])
+        std::string matrix_entries;
+        std::array<uint32_t, MAX_MATRIX_DIM * MAX_MATRIX_DIM + 1> matrix_entry_offsets = {};
 };
 
 
@@ -48,6 +48,12 @@ class Gate : public Cloneable<Gate> {
 
         Token_kind get_gate_source() const;
 
+        void relink(Clone_map& copies) override;
+
+        inline bool linkable() const override {
+            return true;
+        }
+
     private:
         Ptr_coll<Resource_def> resource_defs;
         std::shared_ptr<Resource_def> last_qubit_def;
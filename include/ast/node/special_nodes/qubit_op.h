@@ -29,16 +29,27 @@ class Qubit_op : public Cloneable<Qubit_op> {
 
         bool is_subroutine_op() const;
 
+        void relink(Clone_map& copies) override;
+
         void add_gate_if_subroutine(std::vector<std::shared_ptr<Node>>& subroutine_gates);
 
         std::string resolved_name() const override;
 
-        std::vector<std::string> get_target_qubit_names();
+        const std::vector<unsigned int>& get_target_qubit_ids();
+
+        /// drop the cached target qubits, must be called whenever the qubits below this op are changed
+        inline void invalidate_target_qubits(){
+            target_qubits_cached = false;
+        }
 
     private:
         std::string caller;
         std::shared_ptr<Gate> gate_node = nullptr;
 
+        // cached since every op of every MAP-elites candidate is scored, clones copy it along with the qubits
+        std::vector<unsigned int> target_qubit_ids;
+        bool target_qubits_cached = false;
+
 };
 
 #endif
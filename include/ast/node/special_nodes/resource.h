@@ -25,20 +25,12 @@ class Resource : public Cloneable<Resource> {
             return resource_kind;
         }
 
-        void reset(){
-            used = false;
-        }
-
-        bool is_used(){
-            return used;
-        }
-
         unsigned int n_times_used(){
             return _n_times_used;
         }
 
+        /// whether a resource is currently in use is tracked by its circuit, see `Circuit::use_random_resource`
         void set_used(){
-            used = true;
             _n_times_used += 1;
         }
 
@@ -50,6 +42,11 @@ class Resource : public Cloneable<Resource> {
 
         inline unsigned int get_index() const { return index; }
 
+        /// dense id, unique among the resources of one AST. 0 for dummy resources that were never stored in a circuit
+        inline unsigned int get_resource_id() const { return resource_id; }
+
+        inline void set_resource_id(unsigned int id){ resource_id = id; }
+
         inline std::string resolved_name() const override {
             return name + "[" + std::to_string(index) + "]";
         }
@@ -62,7 +59,7 @@ class Resource : public Cloneable<Resource> {
         }
 
         inline void print_info() const {
-            std::cout << resolved_name() << " " << STR_SCOPE(get_scope()) << STR_RESOURCE_KIND(get_resource_kind()) << " is used: " << used << std::endl;
+            std::cout << resolved_name() << " " << STR_SCOPE(get_scope()) << STR_RESOURCE_KIND(get_resource_kind()) << " times used: " << _n_times_used << std::endl;
         }
 
     private:
@@ -71,8 +68,8 @@ class Resource : public Cloneable<Resource> {
         Scope scope = Scope::GLOB;
         Resource_kind resource_kind;
         bool _from_reg;
-        bool used = false;
         unsigned int _n_times_used = 0;
+        unsigned int resource_id = 0;
 
 };
 
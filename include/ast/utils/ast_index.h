@@ -0,0 +1,49 @@
+#ifndef AST_INDEX_H
+#define AST_INDEX_H
+
+#include <node.h>
+#include <unordered_map>
+
+/*
+    Skeleton of the AST holding only the nodes looked up by kind (circuits, bodies, compound statements, qubit ops), each with its slot
+    and indexed children. Collecting blocks walks the skeleton only, and a mutated block is re-indexed without touching the rest of
+    the tree, which is valid as long as mutations stay inside the subtree of the slot passed to `update`, as passes do
+*/
+class Ast_index {
+
+    public:
+        Ast_index(){}
+
+        Ast_index(Node& root);
+
+        static bool is_indexed_kind(Token_kind kind);
+
+        /// nodes of `kind` strictly below `under`, or below the AST root if `under` is nullptr, in pre-order
+        std::vector<std::shared_ptr<Node>> collect(Token_kind kind, const Node* under = nullptr) const;
+
+        /// slot holding `node`, or nullptr if it is no longer part of the AST
+        Slot_type slot_of(const Node* node) const;
+
+        /// re-index the subtree held by `slot`, after a mutation that replaced or edited `old_node`, the node it held before
+        void update(Slot_type slot, const Node* old_node);
+
+    private:
+        struct Entry {
+            Slot_type slot = nullptr;
+            const Node* parent = nullptr;
+            std::vector<const Node*> children;
+        };
+
+        void index_subtree(Slot_type slot, const Node* parent, std::vector<const Node*>& out);
+
+        void erase_subtree(const Node* node);
+
+        void collect(const std::vector<const Node*>& nodes, Token_kind kind, std::vector<std::shared_ptr<Node>>& out) const;
+
+        std::vector<const Node*>& children_of(const Node* node);
+
+        std::unordered_map<const Node*, Entry> entries;
+        std::vector<const Node*> top_level;
+};
+
+#endif
@@ -12,6 +12,8 @@ class Resource;
 
 class Qubit_op;
 
+class Ast_index;
+
 extern const std::vector<Token_kind> SELF_INVERSE_PAIRS;
 
 extern const std::vector<std::vector<Token_kind>> INVERSE_PAIRS;
@@ -26,6 +28,9 @@ extern const std::vector<Token_kind> CLIFFORDS;
 
 Slot_type find_slot_for(const std::shared_ptr<Node>& search_root, const std::shared_ptr<Node>& target);
 
+/// write node into slot, keeping the parent links needed by `find_slot_for`
+void replace_node(Slot_type slot, std::shared_ptr<Node> node);
+
 std::shared_ptr<Node> build_ast_from_rule(
     std::shared_ptr<Rule> rule,
     const Context& context, 
@@ -45,14 +50,14 @@ std::shared_ptr<Gate> gate_from_anscestor(std::shared_ptr<Node> anscestor);
 
 void move_qubits(const std::shared_ptr<Node> source_qubit_anscestor, Slot_type dest_qubit_anscestor);
 
-unsigned int max_control_flow_depth_rec(const std::shared_ptr<Node> node, unsigned int current_depth);
+unsigned int max_control_flow_depth(const std::shared_ptr<Node> node, unsigned int current_depth);
 
 std::vector<std::shared_ptr<Resource>> resources_from_anscestor(Node& anscestor, Token_kind resource_node_kind);
 
 std::pair<bool, std::shared_ptr<Qubit_op>> qubit_op_is_interesting(
     std::shared_ptr<Qubit_op> qubit_op,
-    std::function<bool(Token_kind, Token_kind)> func, 
-    std::unordered_map<std::string, std::shared_ptr<Qubit_op>>& last_qubit_op_map
+    const std::function<bool(Token_kind, Token_kind)>& func, 
+    std::vector<std::shared_ptr<Qubit_op>>& last_qubit_op_map
 );
 
 bool gate_in_set(const std::vector<Token_kind>& set, Token_kind gate_kind);
@@ -61,7 +66,7 @@ bool is_inverse_pair(Token_kind a, Token_kind b);
 
 bool is_commutative_pair(Token_kind a, Token_kind b);
 
-std::shared_ptr<Node> get_compilation_unit(std::shared_ptr<Node> root);
+std::shared_ptr<Node> get_compilation_unit(const Ast_index& index);
 
 std::unordered_map<Token_kind, Branch_constraint> branch_constraints_for_gate(const Token_kind& gate_kind);
 
@@ -88,8 +88,6 @@ class Info {
 
         float quality();
 
-        unsigned int interesting_pair_count(std::function<bool(Token_kind, Token_kind)> func);
-
         float non_clifford_density();
 
         float entanglement_density();
@@ -99,13 +97,31 @@ class Info {
         float reducibles_density();
 
     private:
+        void count_ops();
+
         std::vector<std::shared_ptr<Qubit_op>> qubit_ops;
 
+        /*
+            per-op contributions to the features and quality, summed in a single pass over the qubit ops. Every candidate is scored from
+            scratch rather than patched from its parent's counts. A pair only ever joins an op to the last op on each of its qubits, so
+            a delta would just rescore the mutated block's ops and the next op on each qubit it touches, but it would need per-op
+            contributions and an interaction multiset kept on every archived genome. That does not pay: the pass is linear in the ops
+            and reads the target qubits cached on them, while the clone every candidate starts from is linear in all AST nodes. For
+            pytket at seeds 3 and 5, `count_ops` takes about 2.5% of MAP-elites time, or 12us a candidate, against about 75% for cloning
+        */
+        unsigned int n_multi_qubit_gates = 0;
+        unsigned int n_non_clifford_gates = 0;
+        unsigned int n_inverse_pairs = 0;
+        unsigned int n_commutative_pairs = 0;
+        unsigned int n_interacting_ops = 0;
+        unsigned int n_distinct_interactions = 0;
+        std::optional<float> cached_quality;
+
         std::vector<Feature> feature_vecs;
         unsigned int archive_size = 1;
 
 };
 
-unsigned int max_control_flow_depth_rec(const std::shared_ptr<Node> node, unsigned int current_depth = 0);
+unsigned int max_control_flow_depth(const std::shared_ptr<Node> node, unsigned int current_depth = 0);
 
 #endif
@@ -6,17 +6,19 @@
 #include <node.h>
 
 /// Node generator class that works like python's iterator to handle looping through the AST
+/// Yields slots of nodes of `kind` below `root` in pre-order, using an explicit stack so a full walk is linear in the tree size.
+/// The yielded slot may be reassigned while iterating, but nodes on the path from `root` to it must not be replaced or resized
 class Node_gen {
 
     public:
         class Iterator {
             public:
-                Iterator(Node& root, Token_kind kind, std::vector<Slot_type>& visited)
-                    : _root(&root), _kind(kind), _visited(&visited) {
-                    _current_slot = _root->find_slot(_kind, *_visited);
+                Iterator(Node& root, Token_kind kind) : _current_slot(nullptr), _kind(kind) {
+                    _stack.push_back({&root, 0});
+                    advance();
                 }
 
-                Iterator() : _current_slot(nullptr), _root(nullptr), _visited(nullptr) {}
+                Iterator() : _current_slot(nullptr), _kind(H) {}
 
                 std::shared_ptr<Node>& operator*() {
                     return *_current_slot;
@@ -33,8 +35,10 @@ class Node_gen {
                 }
 
                 Iterator& operator++() {
-                    if (_root) {
-                        _current_slot = _root->find_slot(_kind, *_visited);
+                    if (_current_slot != nullptr) {
+                        // expand the yielded node only now, in case the caller replaced it
+                        _stack.push_back({_current_slot->get(), 0});
+                        advance();
                     }
                     return *this;
                 }
@@ -42,17 +46,42 @@ class Node_gen {
                 bool operator!=(const Iterator& other) const {
                     return _current_slot != other._current_slot;
                 }
-            
 
                 bool operator==(const Iterator& other) const {
                     return _current_slot == other._current_slot;
                 }
 
             private:
+                struct Frame {
+                    Node* node;
+                    size_t next_child;
+                };
+
+                void advance() {
+                    while (!_stack.empty()) {
+                        Frame& frame = _stack.back();
+
+                        if (frame.next_child < frame.node->size()) {
+                            Slot_type slot = &frame.node->get_children()[frame.next_child++];
+
+                            if ((*slot)->get_node_kind() == _kind) {
+                                _current_slot = slot;
+                                return;
+                            }
+
+                            _stack.push_back({slot->get(), 0});
+
+                        } else {
+                            _stack.pop_back();
+                        }
+                    }
+
+                    _current_slot = nullptr;
+                }
+
                 Slot_type _current_slot;
-                Node* _root;
                 Token_kind _kind;
-                std::vector<Slot_type>* _visited;
+                std::vector<Frame> _stack;
         };
 
         Node_gen(Node& root, Token_kind kind) :
@@ -60,14 +89,13 @@ class Node_gen {
             kind(kind)
         {}
 
-        Iterator begin() {return Iterator(root, kind, visited_slots);}
+        Iterator begin() {return Iterator(root, kind);}
 
         Iterator end() {return Iterator();}
 
     private:
         Node& root;
         Token_kind kind;
-        std::vector<Slot_type> visited_slots;
 };
 
 #endif
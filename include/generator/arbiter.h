@@ -31,6 +31,9 @@ struct Arm {
 
         void apply(Ast_entry& genome, std::shared_ptr<Grammar> grammar);
 
+        // fold in stats of the same arm from another arbiter, averaging blockwise ratios over the `n_merged` arms folded in so far
+        void merge(const Arm& other, unsigned int n_merged);
+
     private:
         std::string mutation_name;
         Mutation_factory factory;
@@ -57,11 +60,15 @@ struct Arbiter {
 
         void record(size_t arm_idx, bool cell_discovered);
 
+        /// fold in stats of an arbiter with the same arms, used to report on parallel workers
+        void merge(const Arbiter& other);
+
         void print_stats(std::ostream& out) const;
 
     private:
         std::vector<Arm> arms;
         unsigned int total_trials = 0;
+        unsigned int n_merged = 1;
 };
 
 #endif
@@ -6,6 +6,8 @@
 #include "info.h"
 #include "arbiter.h"
 #include "cell.h"
+#include <mutex>
+#include <array>
 
 struct Archive {
 
@@ -31,17 +33,29 @@ struct Archive {
         
         void init_archive();
 
-        void fill_archive(std::shared_ptr<Grammar> grammar);
+        /// with more than one thread, workers each mutate their own clones and place them concurrently
+        void fill_archive(std::shared_ptr<Grammar> grammar, unsigned int n_threads = 1);
 
         std::vector<Ast_entry> get_best_genomes();
 
     private:
+        void fill_archive_parallel(std::shared_ptr<Grammar> grammar, unsigned int n_threads);
+
+        std::mutex& cell_lock(unsigned int archive_index){
+            return cell_locks[archive_index % cell_locks.size()];
+        }
+
         Info dummy_info;
 
         const std::vector<Ast_entry>& init_genomes;
         unsigned int n_genomes;
         std::vector<Cell> archive;
         std::vector<unsigned int> filled_archive_indices;  // uniquely filled indices
+        double total_quality = 0.0;  // sum of the qualities of all cells, kept up to date by `place`
+
+        // cells are guarded by striped locks, the filled indices and total quality by their own lock
+        std::array<std::mutex, 64> cell_locks;
+        std::mutex filled_lock;
 
         const fs::path& output_dir;
 };
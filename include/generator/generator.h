@@ -37,6 +37,10 @@ struct Generator {
 
         std::vector<Ast_entry> generate_n_asts(unsigned int n, const Control& control);
 
+        /// @brief Build `n` programs and write each one to `output_dir` as soon as it is built, after removing dead subroutines,
+        /// so that at most a bounded number of ASTs are alive at once. Writes the same programs as `generate_n_asts` followed by `ast_parse`
+        void stream_n_programs(unsigned int n, const Control& control, const fs::path& output_dir);
+
         std::vector<Ast_entry> map_elites(unsigned int n_genomes, const Control& control, const fs::path& output_dir);
 
         inline void print_ast(const Node& root){
@@ -49,6 +53,8 @@ struct Generator {
         }
 
     private:
+        void build_n_asts(unsigned int n, const Control& control, const std::function<void(size_t, Ast_entry&&)>& on_built);
+
         std::shared_ptr<Grammar> grammar;
         std::string entry_name;
         Scope entry_scope;
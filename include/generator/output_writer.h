@@ -0,0 +1,55 @@
+#ifndef OUTPUT_WRITER_H
+#define OUTPUT_WRITER_H
+
+#include <ast.h>
+#include <params.h>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+    Writes programs to `output_dir/circuitN/prog<ext>` on a dedicated thread as soon as they are handed over, so that files reach
+    the disk while the rest of the batch is still being generated, and each AST is freed once written rather than when the whole
+    batch is done. The queue is bounded, so a slow disk throttles the producers instead of letting built ASTs pile up
+*/
+class Output_writer {
+
+    public:
+        Output_writer(const fs::path& _output_dir, const Control& _control, size_t _capacity = QuteFuzz::OUTPUT_QUEUE_SIZE);
+
+        Output_writer(const Output_writer&) = delete;
+        Output_writer& operator=(const Output_writer&) = delete;
+
+        ~Output_writer(){
+            finish();
+        }
+
+        /// queue `entry` to be written as circuit `index`, blocking while the queue is full. Safe to call from several threads
+        void push(size_t index, Ast_entry entry);
+
+        /// write out everything queued so far and stop the writer thread
+        void finish();
+
+    private:
+        void run();
+
+        void write(size_t index, const Ast_entry& entry);
+
+        fs::path output_dir;
+        const Control& control;
+        size_t capacity;
+
+        std::deque<std::pair<size_t, Ast_entry>> queue;
+        std::mutex queue_lock;
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        bool done = false;
+
+        std::ofstream stream;
+        size_t n_written = 0;
+
+        std::thread writer;
+};
+
+#endif
@@ -14,12 +14,12 @@ class Pass {
             blockwise_rate(_blockwise_rate),
             consider_entire_ast(_consider_entire_ast)
         {
-            std::shared_ptr<Node> root = entry.get_root(_consider_entire_ast);
+            if (!Ast_index::is_indexed_kind(block_kind)){
+                ERROR("Passes can only be applied to blocks of a kind held in the AST index");
+            }
 
             // precollect all blocks such that we don't collect added blocks due to mutations
-            for (const auto& block : Node_gen(*root, block_kind)){
-                block_nodes.push_back(block);
-            }
+            block_nodes = entry.get_index()->collect(block_kind, _consider_entire_ast ? nullptr : entry.get_root(false).get());
         }
 
         Token_kind get_block_kind() const { return block_kind; } 
@@ -32,7 +32,7 @@ class Pass {
         virtual ~Pass() = default;
 
     protected:
-        Ast_entry entry;
+        Ast_entry& entry;
         std::shared_ptr<Grammar> grammar;
         Token_kind block_kind;
         float blockwise_rate;
@@ -0,0 +1,83 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <utils.h>
+
+/*
+    Walker/Vose alias table, drawing index i with probability weights[i] / sum(weights) in constant time: one uniform column pick,
+    then a biased coin deciding between the column and its alias. When all weights are equal the coin is skipped, so a draw costs
+    exactly the single `uniform_uint` that picking uniformly always did
+*/
+class Alias_table {
+
+    public:
+        Alias_table(){}
+
+        Alias_table(const std::vector<float>& weights) :
+            prob(weights.size(), 1.0f),
+            alias(weights.size())
+        {
+            size_t n = weights.size();
+
+            if (n == 0) return;
+
+            uniform = std::all_of(weights.begin(), weights.end(), [&](float w){ return w == weights[0]; });
+
+            for (size_t i = 0; i < n; i++){
+                alias[i] = i;
+            }
+
+            if (uniform) return;
+
+            double total = 0.0;
+
+            for (float w : weights){
+                total += w;
+            }
+
+            std::vector<double> scaled(n);
+            std::vector<size_t> small, large;
+
+            for (size_t i = 0; i < n; i++){
+                scaled[i] = weights[i] * n / total;
+                (scaled[i] < 1.0 ? small : large).push_back(i);
+            }
+
+            while (!small.empty() && !large.empty()){
+                size_t s = small.back(); small.pop_back();
+                size_t l = large.back(); large.pop_back();
+
+                prob[s] = scaled[s];
+                alias[s] = l;
+
+                scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+                (scaled[l] < 1.0 ? small : large).push_back(l);
+            }
+
+            // whatever is left is 1 up to rounding error
+            for (size_t i : small) prob[i] = 1.0f;
+            for (size_t i : large) prob[i] = 1.0f;
+        }
+
+        inline size_t size() const { return prob.size(); }
+
+        inline bool is_uniform() const { return uniform; }
+
+        /// index drawn from the table, which must not be empty
+        inline size_t draw() const {
+            size_t column = uniform_uint(prob.size() - 1);
+
+            if (uniform || (uniform_float(1.0, 0.0) < prob[column])){
+                return column;
+            }
+
+            return alias[column];
+        }
+
+    private:
+        std::vector<float> prob;
+        std::vector<size_t> alias;
+        bool uniform = true;
+};
+
+#endif
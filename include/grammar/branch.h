@@ -21,6 +21,11 @@ class Branch {
 
         inline void set_recursive_flag(){recursive = true;}
 
+        /// relative likelihood of this branch being picked among the branches of its rule, set with `@ weight` in the grammar
+        inline float get_weight() const {return weight;}
+
+        inline void set_weight(float _weight){weight = _weight;}
+
         inline void add(const Term& term){terms.push_back(term);}
 
         inline size_t size() const {return terms.size();}
@@ -49,6 +54,10 @@ class Branch {
                 stream << elem << " ";
             }
 
+            if (branch.weight != 1.0f){
+                stream << "@" << branch.weight << " ";
+            }
+
             return stream;
         }
 
@@ -77,16 +86,19 @@ class Branch {
 
             Branch new_branch(_terms);
             new_branch.recursive = recursive;
+            new_branch.weight = weight;
 
             return new_branch;
         }
 
         inline void clear(){
             terms.clear();
+            weight = 1.0f;
         }
 
     private:
         bool recursive = false;
+        float weight = 1.0f;
         std::vector<Term> terms;
 };
 
@@ -3,13 +3,35 @@
 
 #include <utils.h>
 #include <lex.h>
+#include <expr_code.h>
 
 class Context;
 class Rule;
+class Snapshot_writer;
+
+/// tag identifying the kind of expression in a grammar snapshot
+enum class Expr_tag : uint8_t {
+    NONE = 0,
+    INT,
+    FLOAT,
+    VAR,
+    RULE,
+    BLOCK,
+    PROPERTY_ACCESS,
+    BIN,
+    IF,
+    FOR,
+    ASSIGN,
+    MOD,
+};
 
 using Rule_list = std::vector<std::shared_ptr<Rule>>;
 using Expr_type = std::variant<int, bool, float, std::string, std::shared_ptr<Rule>, Rule_list>;
 
+inline Expr_type to_expr_type(const Scalar& value){
+    return std::visit([](auto v) -> Expr_type { return v; }, value);
+}
+
 class Expr {
     public:
         bool paren = false;
@@ -20,12 +42,37 @@ class Expr {
 
         virtual Expr_type eval(Context&) const { return 0; }
 
+        /// evaluate through the compiled code if this expression has any, and by walking the tree otherwise
+        inline Expr_type evaluate(Context& context) const {
+            return (code != nullptr) ? to_expr_type(code->run(context)) : eval(context);
+        }
+
+        /// compile this expression into `Expr_code` if it only produces ints, bools and floats, and otherwise compile the largest
+        /// subexpressions that do. Done once, when the expression is attached to a term while the grammar is built
+        void compile();
+
+        /// nullptr if the expression is not compiled, or cannot be
+        inline const Expr_code* get_code() const { return code.get(); }
+
+        /// append code evaluating this expression to `out`, returning false if it may produce something other than an int, bool or float
+        virtual bool emit(Expr_code&) const { return false; }
+
+        /// compile subexpressions of an expression that could not be compiled as a whole
+        virtual void compile_children() {}
+
         virtual void print(std::ostream& stream) const = 0;
 
+        /// write the tag of this expression followed by its fields, see `Snapshot_reader::expr` for the inverse
+        virtual void serialise(Snapshot_writer& out) const = 0;
+
         friend std::ostream& operator<<(std::ostream& stream, const Expr& expr) {
             expr.print(stream);
             return stream;
         };
+
+    private:
+        bool compiled = false;
+        std::unique_ptr<Expr_code> code = nullptr;
     };
 
 class IntExpr : public Expr {
@@ -38,6 +85,10 @@ class IntExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        bool emit(Expr_code& out) const override;
+
     private:
         int value;
 
@@ -53,6 +104,10 @@ class FloatExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        bool emit(Expr_code& out) const override;
+
     private:
         float value;
 };
@@ -68,6 +123,12 @@ class VarExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        bool emit(Expr_code& out) const override;
+
+        void compile_children() override;
+
     private:
         Token_kind name;
         std::vector<std::unique_ptr<Expr>> args;
@@ -84,6 +145,8 @@ class RuleExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
     private:
         std::string rule_name;
         std::shared_ptr<Rule> rule;
@@ -100,6 +163,12 @@ class BlockExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        bool emit(Expr_code& out) const override;
+
+        void compile_children() override;
+
     private:
         std::vector<std::unique_ptr<Expr>> expressions;
 };
@@ -115,6 +184,10 @@ class PropertyAccessExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        bool emit(Expr_code& out) const override;
+
     private:
         std::string obj_name;
         Token_kind prop_name;
@@ -132,6 +205,12 @@ class BinExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        bool emit(Expr_code& out) const override;
+
+        void compile_children() override;
+
     private:
         std::string op;
         std::unique_ptr<Expr> left;
@@ -152,6 +231,12 @@ class IfExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        bool emit(Expr_code& out) const override;
+
+        void compile_children() override;
+
     private:
         std::unique_ptr<Expr> cond;
         std::unique_ptr<Expr> true_branch;
@@ -170,6 +255,10 @@ class ForExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        void compile_children() override;
+
     private:
         std::string iter_var;
         Token_kind iterable; 
@@ -188,6 +277,8 @@ class AssignExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
     private:
         std::shared_ptr<Rule> rule;
 
@@ -205,6 +296,10 @@ class ModExpr : public Expr {
 
         void print(std::ostream& stream) const override;
 
+        void serialise(Snapshot_writer& out) const override;
+
+        void compile_children() override;
+
     private:
         std::unique_ptr<Expr> expr;
         Token_kind modifier;
@@ -0,0 +1,98 @@
+#ifndef EXPR_CODE_H
+#define EXPR_CODE_H
+
+#include <utils.h>
+#include <lex.h>
+
+class Context;
+
+/// result of an expression that evaluates to an int, bool or float, which unlike `Expr_type` never owns heap memory
+using Scalar = std::variant<int, bool, float>;
+
+enum class Expr_op : uint8_t {
+    PUSH,           // push `constant`
+    VAR,            // pop `arg` arguments, push the value of variable `kind` given them
+    PROPERTY,       // push property `kind` of the object bound to `names[arg]`
+    BIN,            // pop right then left, push `left bin right`
+    JUMP_IF_FALSE,  // pop a condition, continue at instruction `arg` if it is false
+    JUMP,           // continue at instruction `arg`
+    POP,
+};
+
+enum class Bin_op : uint8_t {
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    GE,
+    LE,
+    EQ,
+    NE,
+    GT,
+    LT,
+    AND,
+    OR,
+};
+
+struct Expr_instr {
+    Expr_op op;
+    Bin_op bin = Bin_op::ADD;
+    Token_kind kind = RULE;
+    uint32_t arg = 0;
+    Scalar constant = 0;
+};
+
+/*
+    Stack code for an expression tree that only ever produces ints, bools and floats, such as `[UNIFORM(30, 60)]` or `[GET_GATE_QUBITS - 1]`.
+    Instructions are emitted in the order the tree evaluates its subexpressions, so random draws happen in the same order as walking the tree,
+    and running the code uses a fixed size stack, so evaluation never allocates
+*/
+class Expr_code {
+
+    public:
+        static constexpr size_t MAX_STACK = 16;
+
+        Expr_code(){}
+
+        inline void push(Scalar value){ add({.op = Expr_op::PUSH, .constant = value}, 1); }
+
+        inline void var(Token_kind name, uint32_t n_args){ add({.op = Expr_op::VAR, .kind = name, .arg = n_args}, 1 - (int)n_args); }
+
+        inline void property(const std::string& obj_name, Token_kind prop){
+            names.push_back(obj_name);
+            add({.op = Expr_op::PROPERTY, .kind = prop, .arg = (uint32_t)(names.size() - 1)}, 1);
+        }
+
+        inline void bin(Bin_op op){ add({.op = Expr_op::BIN, .bin = op}, -1); }
+
+        inline void pop(){ add({.op = Expr_op::POP}, -1); }
+
+        /// jumps are emitted with no target, returning their position so that `patch` can point them at the next instruction once it is known
+        inline size_t jump_if_false(){ add({.op = Expr_op::JUMP_IF_FALSE}, -1); return instrs.size() - 1; }
+
+        inline size_t jump(){ add({.op = Expr_op::JUMP}, 0); return instrs.size() - 1; }
+
+        inline void patch(size_t jump_pos){ instrs[jump_pos].arg = instrs.size(); }
+
+        /// the else branch starts from the stack depth the then branch started from, not the one it left behind
+        inline void start_else(){ depth -= 1; }
+
+        /// whether the code can run on the fixed size stack
+        inline bool fits() const { return max_depth <= (int)MAX_STACK; }
+
+        Scalar run(Context& context) const;
+
+    private:
+        inline void add(Expr_instr instr, int stack_change){
+            instrs.push_back(instr);
+            depth += stack_change;
+            max_depth = std::max(max_depth, depth);
+        }
+
+        std::vector<Expr_instr> instrs;
+        std::vector<std::string> names;
+        int depth = 0;
+        int max_depth = 0;
+};
+
+#endif
@@ -16,6 +16,7 @@
 struct Current {
     std::shared_ptr<Rule> rule = nullptr;
     Branch branch;
+    bool branch_weighted = false;  // `@ weight` already given for the branch being parsed
     Print_mode print_mode = Print_mode::DEFAULT;
 
     Current(){}
@@ -30,7 +31,8 @@ class Grammar{
     public:
         Grammar(){}
 
-        Grammar(const fs::path& filename, std::vector<Token>& meta_grammar_tokens);
+        /// @brief Grammar parsed from the meta grammar's tokens followed by those of `filename`. The meta grammar's tokens are shared by every grammar, not copied
+        Grammar(const fs::path& filename, std::shared_ptr<const std::vector<Token>> meta_grammar_tokens);
 
         std::string dig_to_syntax(const std::string& rule_name) const;
 
@@ -44,6 +46,12 @@ class Grammar{
             while(parse_token() != until);
         }
 
+        /// @brief Work out how many nodes each branch needs at least to finish expanding, see `Rule::update_costs`. Done once the grammar is built
+        void compute_branch_costs();
+
+        /// @brief Build the alias tables every rule draws weighted branches from. Done once the grammar is built or loaded
+        void build_branch_tables();
+
         void print_rules() const;
 
         void print_tokens() const;
@@ -54,6 +62,16 @@ class Grammar{
 
         inline std::string get_path(){return path.string();}
 
+        /// @brief Fingerprint of everything a built grammar depends on: the snapshot format, the lexer's keyword table, and the contents
+        /// of the meta grammar and grammar files. A snapshot saved under a different key is stale
+        static uint64_t snapshot_key(const fs::path& meta_grammar_path, const fs::path& grammar_path);
+
+        /// @brief Write the built grammar to `file` so that later runs can load it instead of lexing and parsing the templates again
+        void save_snapshot(const fs::path& file, uint64_t key) const;
+
+        /// @brief Load a grammar written by `save_snapshot`, or nullopt if `file` is missing, corrupt or was saved under a different key
+        static std::optional<Grammar> load_snapshot(const fs::path& file, uint64_t key, const fs::path& grammar_path);
+
         friend std::ostream& operator<<(std::ostream& stream, const Grammar& grammar){
             for(const auto& p : grammar.rule_pointers){
                 std::cout << *p << std::endl;
@@ -74,6 +92,10 @@ class Grammar{
 
         void peek();
 
+        inline const Token& token_at(size_t i) const {
+            return (i < meta_tokens->size()) ? (*meta_tokens)[i] : tokens[i - meta_tokens->size()];
+        }
+
         void back();
 
         void add_term_to_current_branch(const Term& term);
@@ -108,8 +130,9 @@ class Grammar{
         void complete_rule();
         
         /*
-            moving through the tokens
+            moving through the tokens, those of the meta grammar first
         */
+        std::shared_ptr<const std::vector<Token>> meta_tokens = std::make_shared<const std::vector<Token>>();
         std::vector<Token> tokens;
         size_t num_tokens = 0;
         size_t token_pointer = 0;
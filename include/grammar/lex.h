@@ -1,7 +1,9 @@
 #ifndef LEX_H
 #define LEX_H
 
-#include <regex>
+#include <array>
+#include <algorithm>
+#include <string_view>
 #include <stdio.h>
 #include "string.h"
 #include <stdlib.h>
@@ -158,6 +160,7 @@ enum Token_kind {
     EXTERNAL,
     GLOB,
     SCOPE_RES,
+    BRANCH_WEIGHT,
 };
 
 inline std::string kind_as_str(const Token_kind& kind);
@@ -180,23 +183,18 @@ struct Token{
 
 struct Token_matcher {
 
-    Token_matcher(const std::string& p, const Token_kind& k){
-        pattern = p;
-        kind = k;
-    }
-
-    Token_matcher(const std::string& p, const Token_kind& k, std::optional<std::string> r){
-        pattern = p;
-        kind = k;
-        replacement = r;
-    }
+    constexpr Token_matcher(std::string_view p, const Token_kind& k, std::optional<std::string_view> r = std::nullopt) :
+        pattern(p),
+        kind(k),
+        replacement(r)
+    {}
 
-    std::string pattern;
+    std::string_view pattern;
     Token_kind kind;
-    std::optional<std::string> replacement = std::nullopt;
+    std::optional<std::string_view> replacement = std::nullopt;
 };
 
-const std::vector<Token_matcher> TOKEN_RULES = {
+constexpr Token_matcher TOKEN_RULES[] = {
     /*
         special rules
     */
@@ -350,6 +348,7 @@ const std::vector<Token_matcher> TOKEN_RULES = {
     Token_matcher("ci", CHILD_INDENT),
     Token_matcher("si", SELF_INDENT),
     Token_matcher("::", SCOPE_RES),
+    Token_matcher("@", BRANCH_WEIGHT),
     Token_matcher("->", ARROW),
     Token_matcher("+=", RULE_APPEND),
     Token_matcher("=", RULE_START),
@@ -369,9 +368,32 @@ const std::vector<Token_matcher> TOKEN_RULES = {
     Token_matcher("+", ONE_OR_MORE),
 };
 
-const std::string FULL_REGEX =
-    R"([a-zA-Z_][a-zA-Z0-9_]*|(\-)?[0-9]+(\.[0-9]+)?|#[^\n]*|\(\*|\*\)|\".*?\"|\'.*?\'|->|::|\+=|>=|<=|==|!=|&&|\|\||.)";
+/// indices into TOKEN_RULES sorted by pattern, with ties kept in table order so that, as with a linear scan, the first matcher listed for a pattern wins
+constexpr auto TOKEN_RULES_BY_PATTERN = [](){
+    std::array<size_t, std::size(TOKEN_RULES)> indices{};
+
+    for(size_t i = 0; i < indices.size(); i++){
+        indices[i] = i;
+    }
+
+    std::sort(indices.begin(), indices.end(), [](size_t a, size_t b){
+        return (TOKEN_RULES[a].pattern < TOKEN_RULES[b].pattern) || ((TOKEN_RULES[a].pattern == TOKEN_RULES[b].pattern) && (a < b));
+    });
+
+    return indices;
+}();
 
+/// @brief Exact qf token with this text, or nullptr if there is none
+inline const Token_matcher* find_token_matcher(std::string_view text){
+    auto it = std::lower_bound(TOKEN_RULES_BY_PATTERN.begin(), TOKEN_RULES_BY_PATTERN.end(), text,
+        [](size_t i, std::string_view t){ return TOKEN_RULES[i].pattern < t; });
+
+    if((it != TOKEN_RULES_BY_PATTERN.end()) && (TOKEN_RULES[*it].pattern == text)){
+        return &TOKEN_RULES[*it];
+    }
+
+    return nullptr;
+}
 
 class Lexer{
     public:
@@ -383,6 +405,11 @@ class Lexer{
             lex();
         }
 
+        /// lexer holding tokens lexed earlier, such as those restored from a grammar snapshot
+        Lexer(std::vector<Token> _tokens)
+            :tokens(std::move(_tokens))
+        {}
+
         std::string remove_outer_quotes(const std::string& token){
             if ((token.size() > 2) &&
                 (((token.front() == '\"') && (token.back() == '\"')) ||
@@ -394,23 +421,75 @@ class Lexer{
             return token;
         }
 
-        void lex(){
-            std::string input, matched_string;
-            std::ifstream stream(_filename);
+        /*
+            Length of the lexeme starting at `pos`, trying in order: identifiers, numbers, line comments, comment delimiters, quoted strings,
+            two character operators, and finally any single character other than a line terminator. As with regex alternation, the first
+            alternative that matches is taken, not the longest. Returns 0 if nothing matches, in which case the character is skipped
+        */
+        static size_t lexeme_length(std::string_view line, size_t pos){
+            auto is_digit = [](char c){ return (c >= '0') && (c <= '9'); };
+            auto is_ident_start = [](char c){ return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c == '_'); };
+            auto is_line_terminator = [](char c){ return (c == '\n') || (c == '\r'); };
+
+            const size_t size = line.size();
+            const char c = line[pos];
+            size_t end = pos;
+
+            // [a-zA-Z_][a-zA-Z0-9_]*
+            if (is_ident_start(c)){
+                do { end++; } while ((end < size) && (is_ident_start(line[end]) || is_digit(line[end])));
+                return end - pos;
+            }
+
+            // (\-)?[0-9]+(\.[0-9]+)?
+            if (c == '-') end++;
+
+            if ((end < size) && is_digit(line[end])){
+                while ((end < size) && is_digit(line[end])) end++;
+
+                if ((end + 1 < size) && (line[end] == '.') && is_digit(line[end + 1])){
+                    end++;
+                    while ((end < size) && is_digit(line[end])) end++;
+                }
 
-            std::regex full_pattern(FULL_REGEX, std::regex::icase);
+                return end - pos;
+            }
+
+            // #[^\n]*
+            if (c == '#') return size - pos;
+
+            std::string_view rest = line.substr(pos);
+
+            if (rest.starts_with("(*") || rest.starts_with("*)")) return 2;
+
+            // ".*?" and '.*?', where . does not match line terminators
+            if ((c == '\"') || (c == '\'')){
+                for (end = pos + 1; (end < size) && !is_line_terminator(line[end]); end++){
+                    if (line[end] == c) return end - pos + 1;
+                }
+            }
 
-            std::sregex_iterator end;
+            for (std::string_view op : {"->", "::", "+=", ">=", "<=", "==", "!=", "&&", "||"}){
+                if (rest.starts_with(op)) return 2;
+            }
+
+            return is_line_terminator(c) ? 0 : 1;
+        }
+
+        void lex(){
+            std::ifstream stream(_filename);
+            std::string input;
 
             bool in_multiline_comment = false;
 
             while(std::getline(stream, input)){
 
-                std::sregex_iterator begin(input.begin(), input.end(), full_pattern);
-                std::sregex_iterator end;
+                for(size_t pos = 0, length; pos < input.size(); pos += std::max(length, size_t(1))){
+                    length = lexeme_length(input, pos);
 
-                for(std::sregex_iterator i = begin; i != end; ++i){
-                    std::string text = i->str();
+                    if (length == 0) continue;
+
+                    std::string_view text(input.data() + pos, length);
 
                     /*
                         ignore comments
@@ -439,32 +518,24 @@ class Lexer{
                     }
 
                     // find exact qf tokens
-                    bool found_keyword = false;
-
-                    for(const Token_matcher& tm : TOKEN_RULES) {
-                        if (text == tm.pattern) {
-                            tokens.push_back(Token{tm.replacement.value_or(text), tm.kind});
-                            found_keyword = true;
-                            break;
-                        }
+                    if (const Token_matcher* tm = find_token_matcher(text)) {
+                        tokens.push_back(Token{std::string(tm->replacement.value_or(text)), tm->kind});
+                        continue;
                     }
 
-                    if (found_keyword) continue;
-
-
                     // classify generics
                     if (isalpha(text[0]) || text[0] == '_') {
-                        tokens.push_back(Token{text, RULE});
+                        tokens.push_back(Token{std::string(text), RULE});
 
                     } else if (isdigit(text[0]) || ((text[0] == '-') && (text.size() > 1) && isdigit(text[1]))) {
                         if (text.find('.') != std::string::npos) {
-                            tokens.push_back(Token{text, FLOAT});
+                            tokens.push_back(Token{std::string(text), FLOAT});
                         } else {
-                            tokens.push_back(Token{text, INTEGER});
+                            tokens.push_back(Token{std::string(text), INTEGER});
                         }
 
                     } else {
-                        tokens.push_back(Token{remove_outer_quotes(text), STRING});
+                        tokens.push_back(Token{remove_outer_quotes(std::string(text)), STRING});
                     }
                 }
             }
@@ -478,7 +549,7 @@ class Lexer{
             }
         }
 
-        std::vector<Token> get_tokens(){
+        std::vector<Token> get_tokens() const {
             return tokens;
         }
 
@@ -522,9 +593,9 @@ inline std::string kind_as_str(const Token_kind& kind) {
     
     std::string str = std::to_string(kind);
 
-    for (auto tm : TOKEN_RULES){
+    for (const Token_matcher& tm : TOKEN_RULES){
         if(tm.kind == kind){
-            str = tm.pattern;
+            str = std::string(tm.pattern);
         }
     }
 
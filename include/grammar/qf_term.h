@@ -21,6 +21,10 @@ class Term {
 
         inline void add_expr(std::shared_ptr<Expr> _expr){
             expr = _expr;
+
+            if (expr != nullptr){
+                expr->compile();
+            }
         }
 
         inline std::shared_ptr<Expr> get_expr() const {
@@ -41,17 +45,26 @@ class Term {
 
         bool is_rule() const;
 
+        /// bytes of syntax this term writes out, 0 for rules
+        inline size_t syntax_size() const {
+            const std::string* syntax = std::get_if<std::string>(&value);
+            return (syntax == nullptr) ? 0 : syntax->size();
+        }
+
         friend std::ostream& operator<<(std::ostream& stream, const Term& term);
 
         bool operator==(const Term& other) const;
         
         std::vector<Term> eval_expr(Context& context) const;
 
+        /// number of copies of this term an expression that evaluated to `value` asks for
+        unsigned int repeat_count(const Scalar& value) const;
+
         Token_kind get_node_kind() const {return kind;}
 
     private:
         std::variant<std::weak_ptr<Rule>, std::string> value;
-        Token_kind kind;
+        Token_kind kind = _EOF;
         Print_mode pm = Print_mode::DEFAULT;
         std::shared_ptr<Expr> expr = nullptr;
 };
@@ -5,12 +5,38 @@
 #include "node.h"
 #include "utils.h"
 #include <rule_utils.h>
+#include <alias_table.h>
 
 class Node;
 
+/// @brief Indices of some of a rule's branches, with an alias table over their weights to draw one of them. The table is only built by
+/// `build_table`, once the set is final, so that adding n branches stays linear
+struct Branch_set {
+    std::vector<size_t> indices;
+    std::vector<float> weights;
+    Alias_table table;
+
+    inline void add(size_t index, float weight){
+        indices.push_back(index);
+        weights.push_back(weight);
+    }
+
+    inline void build_table(){ table = Alias_table(weights); }
+
+    inline bool empty() const { return indices.empty(); }
+
+    inline size_t draw() const {
+        assert(table.size() == indices.size());
+        return indices[table.draw()];
+    }
+};
+
 class Rule {
 
     public:
+        /// cost of a branch that cannot finish expanding, or not known to
+        static constexpr unsigned int UNBOUNDED_COST = UINT32_MAX;
+
         Rule(){}
 
         Rule(const Token& _token, const Scope& _scope) :
@@ -28,17 +54,38 @@ class Rule {
 
         bool get_recursive_flag() const {return recursive;}
 
-        std::vector<Branch> get_branches(){return branches;}
+        const std::vector<Branch>& get_branches() const {return branches;}
 
         void add(const Branch& b);
 
+        /// build the alias tables of all branch sets, once every branch has been added. Until then, weighted picks draw from stale tables
+        void build_tables();
+
         inline size_t size(){return branches.size();}
 
         inline bool is_empty() const {return branches.empty();}
 
-        inline void clear(){branches.clear();}
+        inline void clear(){
+            branches.clear();
+            all_branches = Branch_set();
+            branches_by_occurances.clear();
+            branch_costs.clear();
+            min_cost = UNBOUNDED_COST;
+        }
+
+        /// fewest nodes needed to finish expanding this rule, always picking the cheapest branch
+        inline unsigned int get_min_cost() const {return min_cost;}
 
-        Branch pick_branch(std::shared_ptr<Node> rule_as_node);
+        /// recompute branch costs from the current costs of the rules they refer to, returning whether the cheapest changed. Costs are
+        /// worked out as branches are added, so rules referring to rules defined later (or to themselves) need repeated updates to settle
+        bool update_costs();
+
+        /// branches in which a rule of `kind` appears exactly `n_occurances` times
+        const Branch_set& admissible_branches(Token_kind kind, unsigned int n_occurances) const;
+
+        /// @brief Pick a branch, in proportion to branch weights, among those satisfying the branch constraint of `rule_as_node`, if any. The reference stays valid as long as the rule is alive
+        /// With `cheapest`, the branch needing the fewest nodes to finish expanding is picked instead, without drawing from the generator
+        const Branch& pick_branch(std::shared_ptr<Node> rule_as_node, bool cheapest = false) const;
 
         bool contains_rule(const Token_kind& other_rule);
 
@@ -68,6 +115,18 @@ class Rule {
         Scope scope = Scope::GLOB;
         std::vector<Branch> branches;
         bool recursive = false;
+
+        /*
+            admissible branches for every branch constraint, kept up to date as branches are added so that picking a constrained branch
+            is a single (weighted) draw. Keyed by rule kind, then by number of occurances of that kind in the branch. Kinds that appear in no
+            branch are left out, as all branches have 0 of them
+        */
+        Branch_set all_branches;
+        std::unordered_map<Token_kind, std::unordered_map<unsigned int, Branch_set>> branches_by_occurances;
+
+        /// nodes each branch needs at least to finish expanding, counting a term with an expression once
+        std::vector<unsigned int> branch_costs;
+        unsigned int min_cost = UNBOUNDED_COST;
 };
 
 #endif
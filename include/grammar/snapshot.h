@@ -0,0 +1,143 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <utils.h>
+#include <cstring>
+#include <unordered_map>
+
+class Rule;
+class Expr;
+
+/*
+    Flat little-endian byte encoding of a built grammar. Rules are written once, in the grammar's rule order, and every reference to a
+    rule (from a term or an expression) is written as its position in that order, so the rule graph, cycles included, is restored
+    exactly on load
+*/
+class Snapshot_writer {
+
+    public:
+        Snapshot_writer(const std::vector<std::shared_ptr<Rule>>& rules){
+            for(size_t i = 0; i < rules.size(); i++){
+                rule_ids[rules[i].get()] = i;
+            }
+        }
+
+        inline void u8(uint8_t v){ data.push_back(static_cast<char>(v)); }
+
+        inline void u32(uint32_t v){ raw(&v, sizeof(v)); }
+
+        inline void u64(uint64_t v){ raw(&v, sizeof(v)); }
+
+        inline void i32(int32_t v){ raw(&v, sizeof(v)); }
+
+        inline void f32(float v){ raw(&v, sizeof(v)); }
+
+        inline void str(const std::string& s){
+            u32(s.size());
+            data.append(s);
+        }
+
+        /// rule ids are shifted by 1 so that 0 can stand for nullptr
+        inline void rule(const std::shared_ptr<Rule>& r){
+            if (r == nullptr){
+                u32(0);
+            } else {
+                auto it = rule_ids.find(r.get());
+
+                if (it == rule_ids.end()){
+                    ERROR("Rule referenced by the grammar is not one of its rules");
+                }
+
+                u32(it->second + 1);
+            }
+        }
+
+        void expr(const Expr* e);
+
+        inline const std::string& get_data() const { return data; }
+
+    private:
+        inline void raw(const void* src, size_t n){
+            data.append(static_cast<const char*>(src), n);
+        }
+
+        std::string data;
+        std::unordered_map<const Rule*, size_t> rule_ids;
+};
+
+/*
+    Reads back what `Snapshot_writer` wrote. Reads past the end, or that would produce something the writer could not have written,
+    mark the reader as failed and return zero values instead of stopping, so that a truncated or corrupt snapshot is simply rebuilt
+*/
+class Snapshot_reader {
+
+    public:
+        Snapshot_reader(std::string_view _data) : data(_data) {}
+
+        inline bool failed() const { return fail; }
+
+        inline bool at_end() const { return pos == data.size(); }
+
+        inline void set_rules(const std::vector<std::shared_ptr<Rule>>& _rules){ rules = _rules; }
+
+        /// read a count of items that each take at least `min_item_size` bytes, failing if the rest of the data cannot hold them
+        inline uint32_t count(size_t min_item_size = 1){
+            uint32_t n = u32();
+
+            if (n > (data.size() - pos) / std::max(min_item_size, size_t(1))){
+                fail = true;
+                return 0;
+            }
+
+            return n;
+        }
+
+        inline uint8_t u8(){ uint8_t v = 0; raw(&v, sizeof(v)); return v; }
+
+        inline uint32_t u32(){ uint32_t v = 0; raw(&v, sizeof(v)); return v; }
+
+        inline uint64_t u64(){ uint64_t v = 0; raw(&v, sizeof(v)); return v; }
+
+        inline int32_t i32(){ int32_t v = 0; raw(&v, sizeof(v)); return v; }
+
+        inline float f32(){ float v = 0; raw(&v, sizeof(v)); return v; }
+
+        inline std::string str(){
+            uint32_t n = count();
+            std::string s(data.substr(pos, n));
+            pos += n;
+            return s;
+        }
+
+        inline std::shared_ptr<Rule> rule(){
+            uint32_t id = u32();
+
+            if (id > rules.size()){
+                fail = true;
+                return nullptr;
+            }
+
+            return (id == 0) ? nullptr : rules[id - 1];
+        }
+
+        std::unique_ptr<Expr> expr();
+
+    private:
+        inline void raw(void* dst, size_t n){
+            if (fail || (data.size() - pos < n)){
+                fail = true;
+                return;
+            }
+
+            std::memcpy(dst, data.data() + pos, n);
+            pos += n;
+        }
+
+        std::string_view data;
+        size_t pos = 0;
+        bool fail = false;
+
+        std::vector<std::shared_ptr<Rule>> rules;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef TEMP_RULE_POOL_H
+#define TEMP_RULE_POOL_H
+
+#include <rule.h>
+
+/*
+    Rules made by assignments inside grammar expressions (`name = ... ;`). Terms only hold weak pointers to rules, so the pool keeps every
+    rule made during a build alive until the build is done. The rules are then reused by later builds on the same thread, except those
+    still referred to from elsewhere (such as the bindings of a context kept for mutation), which are left to their other owners.
+
+    Builds nest, since mutations build subtrees while a pass runs, so each build gives back only the rules acquired within its scope
+*/
+class Temp_rule_pool {
+
+    public:
+        /// empty rule named `name`, bound by the caller to the name of the assigned rule
+        static std::shared_ptr<Rule> acquire(const std::string& name){
+            Temp_rule_pool& pool = local();
+
+            if (pool.n_used == pool.rules.size()){
+                pool.rules.push_back(nullptr);
+            }
+
+            std::shared_ptr<Rule>& rule = pool.rules[pool.n_used++];
+            Token token{"__temp_assign_" + name, RULE};
+
+            if (rule == nullptr){
+                rule = std::make_shared<Rule>(token, Scope::GLOB);
+            } else {
+                *rule = Rule(token, Scope::GLOB);
+            }
+
+            return rule;
+        }
+
+        /// @brief Rules acquired by this thread during the lifetime of the scope are given back to the pool when it ends
+        class Build_scope {
+            public:
+                Build_scope() :
+                    mark(local().n_used)
+                {}
+
+                Build_scope(const Build_scope&) = delete;
+                Build_scope& operator=(const Build_scope&) = delete;
+
+                ~Build_scope(){
+                    Temp_rule_pool& pool = local();
+
+                    for (size_t i = mark; i < pool.n_used; i++){
+                        if (pool.rules[i].use_count() > 1){
+                            pool.rules[i] = nullptr;
+                        }
+                    }
+
+                    pool.n_used = mark;
+                }
+
+            private:
+                size_t mark;
+        };
+
+    private:
+        static inline Temp_rule_pool& local(){
+            thread_local Temp_rule_pool pool;
+            return pool;
+        }
+
+        std::vector<std::shared_ptr<Rule>> rules;
+        size_t n_used = 0;
+};
+
+#endif
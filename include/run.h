@@ -8,34 +8,63 @@
 #include <generator.h>
 #include <run_utils.h>
 
+/// @brief Options for a headless run, parsed from the command line
+struct Batch_options {
+    fs::path grammars_dir = "../templates";
+    std::string grammar_name;
+    std::string entry_name = "program";
+    std::optional<unsigned int> seed = std::nullopt;
+    unsigned int n_programs = 1;
+    std::optional<fs::path> output_dir = std::nullopt;
+    bool map_elites = false;
+    unsigned int n_threads = 1;
+    bool quiet = true;  // headless runs only print warnings and errors unless asked with `--verbose`
+};
+
 class Run{
 
     static const fs::path OUTPUT_DIR;
 
+    /// built grammars are snapshotted here, next to the `qf` binary whichever directory it is run from, and reloaded while their templates are unchanged
+    static const fs::path GRAMMAR_CACHE_DIR;
+
     public:
         Run(const std::string& _grammars_dir);
 
         inline bool is_grammar(const std::string& name){
-            return generators.find(name) != generators.end();
+            return grammar_files.find(name) != grammar_files.end();
         }
 
         void help();
 
-        void set_grammar(Control& control);
+        /// build the grammar in `grammars_dir` called `name`, or load it from its snapshot if that is up to date, returning false if there is no such grammar
+        bool build_grammar(const std::string& name);
+
+        /// select the grammar to generate from, building it first if this is the first time it is used
+        void set_grammar(const std::string& grammar_name, const std::string& entry_name, Control& control);
 
         void tokenise(const std::string& command, const char& delim);
 
-        void remove_all_in_dir(const fs::path& dir);
+        /// remove the programs, seeds and archive dumps of a previous run from `dir`, leaving anything else in it alone
+        void remove_outputs_in_dir(const fs::path& dir);
+
+        /// generate `n_programs` programs from the current grammar and write them to the current output directory
+        void generate(unsigned int n_programs, Control& control);
 
         void loop();
 
-        inline void setup_output_dir(const std::string& grammar_name) {
-            current_output_dir = OUTPUT_DIR / grammar_name;
+        /// @brief Generate programs as described by `options` without the REPL, returning the process exit code
+        int batch(const Batch_options& options);
+
+        static Batch_options parse_batch_options(int argc, char** argv);
+
+        inline void setup_output_dir(const fs::path& dir) {
+            current_output_dir = dir;
 
             if(fs::exists(current_output_dir)){
-                remove_all_in_dir(current_output_dir);
+                remove_outputs_in_dir(current_output_dir);
             } else {
-                fs::create_directory(current_output_dir);
+                fs::create_directories(current_output_dir);
             }
         }
 
@@ -43,6 +72,10 @@ class Run{
         fs::path grammars_dir;
         fs::path current_output_dir;
 
+        fs::path meta_grammar_path;
+        std::shared_ptr<const std::vector<Token>> meta_grammar_tokens = nullptr;
+        std::unordered_map<std::string, fs::path> grammar_files;
+
         std::unordered_map<std::string, std::shared_ptr<Generator>> generators;
         std::shared_ptr<Generator> current_generator = nullptr;
         std::vector<std::string> tokens;
@@ -1,6 +1,8 @@
 #ifndef RUN_UTILS_H
 #define RUN_UTILS_H
 
+#include <resource_kind.h>
+
 enum Clamp_dir {
     NO_CLAMP,
     CLAMP_DOWN,
@@ -31,12 +33,49 @@ struct Expected{
     {}
 };
 
+/// @brief Expected values and rules of the current grammar, resolved once by `Control::resolve` so that generation reads plain fields
+struct Resolved_control {
+    unsigned int max_reg_size = 0;
+    unsigned int nested_max_depth = 0;
+    unsigned int max_ast_depth = 0;
+    unsigned int max_ast_nodes = 0;
+    unsigned int max_ast_bytes = 0;
+    unsigned int max_ast_millis = 0;
+
+    std::shared_ptr<Rule> gate_op = nullptr;
+
+    /// whether the grammar can define a register / singular resource, indexed by [Resource_kind][scope index]
+    bool can_use_reg[3][3] = {};
+    bool can_use_sing[3][3] = {};
+
+    static inline size_t scope_index(Scope scope){
+        switch(scope){
+            case Scope::EXT: return 0;
+            case Scope::GLOB: return 1;
+            case Scope::INT: return 2;
+            case Scope::NONE: break;
+        }
+
+        // NONE, or several scopes or'ed together
+        ERROR("Resource definitions must have exactly one of EXT, GLOB or INT scope");
+    }
+
+    inline bool can_define_reg(Resource_kind rk, Scope scope) const {
+        return can_use_reg[(size_t)rk][scope_index(scope)];
+    }
+
+    inline bool can_define_sing(Resource_kind rk, Scope scope) const {
+        return can_use_sing[(size_t)rk][scope_index(scope)];
+    }
+};
+
 struct Control {
     unsigned int GLOBAL_SEED_VAL;
     bool render;
     bool step;
     bool print_circuit_info;
     bool map_elites;
+    unsigned int n_threads;
     
     std::string ext;
 
@@ -62,6 +101,30 @@ struct Control {
 
         throw std::runtime_error("Expected rule " + name + " " + STR_SCOPE(scope) + " not found in control");
     }
+
+    /// filled by `resolve`, after the expected values and rules have been set for the current grammar
+    Resolved_control resolved;
+
+    void resolve(){
+        const std::string kind_names[3] = {"qubit", "bit", "param"};
+
+        resolved.max_reg_size = get_value("MAX_REG_SIZE");
+        resolved.nested_max_depth = get_value("NESTED_MAX_DEPTH");
+        resolved.max_ast_depth = get_value("MAX_AST_DEPTH");
+        resolved.max_ast_nodes = get_value("MAX_AST_NODES");
+        resolved.max_ast_bytes = get_value("MAX_AST_BYTES");
+        resolved.max_ast_millis = get_value("MAX_AST_MILLIS");
+        resolved.gate_op = get_rule("gate_op");
+
+        for(size_t rk = 0; rk < 3; rk++){
+            for(Scope scope : {Scope::EXT, Scope::GLOB, Scope::INT}){
+                size_t s = Resolved_control::scope_index(scope);
+
+                resolved.can_use_reg[rk][s] = !get_rule("register_" + kind_names[rk] + "_def", scope)->is_empty();
+                resolved.can_use_sing[rk][s] = !get_rule("singular_" + kind_names[rk] + "_def", scope)->is_empty();
+            }
+        }
+    }
 };
 
 #endif
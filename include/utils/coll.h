@@ -4,7 +4,6 @@
 #include <utils.h>
 #include <rule_utils.h>
 
-class Resource;
 class Resource_def;
 
 template<typename T>
@@ -62,6 +61,4 @@ inline std::shared_ptr<T> get_random_from_coll(const Ptr_coll<T>& collection, Pt
     return elem;
 }
 
-std::shared_ptr<Resource> get_biased_random_from_coll(const Ptr_coll<Resource>& collection, Ptr_pred_type<Resource> pred, unsigned int total_times_used);
-
 #endif
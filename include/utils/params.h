@@ -22,10 +22,20 @@ constexpr unsigned int MAX_REG_SIZE = 10;
 constexpr unsigned int MAX_NUM_SUBROUTINES = 10;
 constexpr unsigned int NESTED_MAX_DEPTH = 7;
 
-// these values can maybe be calculated based on system stack size
 // wildcard control needs care, for example in circuit creation of resources
 constexpr unsigned int WILDCARD_MAX = 10;
-constexpr unsigned int RECURSION_LIMIT = 4500;
+
+// longest chain of rule expansions from the root of an AST to a leaf, a budget grammars may raise or lower with `MAX_AST_DEPTH = n;`
+constexpr unsigned int MAX_AST_DEPTH = 4500;
+
+// per-AST budgets on nodes, bytes of syntax and wall time, past which the AST is finished with the shortest branches of each rule.
+// grammars may set their own with `MAX_AST_NODES = n;`, `MAX_AST_BYTES = n;` and `MAX_AST_MILLIS = n;`
+constexpr unsigned int MAX_AST_NODES = 250000;
+constexpr unsigned int MAX_AST_BYTES = 4 * 1024 * 1024;
+constexpr unsigned int MAX_AST_MILLIS = 10000;
+
+// number of built programs that may wait to be written to disk before generation blocks
+constexpr unsigned int OUTPUT_QUEUE_SIZE = 64;
 
 };
 
@@ -97,6 +97,12 @@ enum class Print_mode {
     SELF_INDENT,
 };
 
+/// silence INFO and other progress output, sending warnings to stderr so that only warnings and errors are printed
+void set_quiet(bool _quiet);
+
+/// progress output that is not a single INFO line, such as stats tables, goes here so that quiet mode drops it
+std::ostream& info_stream();
+
 [[noreturn]]
 void ERROR(const std::string& msg, std::source_location location = std::source_location::current());
 
@@ -4,6 +4,7 @@
 	utils
 */
 #include <sstream>
+#include <deque>
 
 /*
 	node kinds
@@ -17,6 +18,7 @@
 #include <primitive_gate.h>
 
 #include <info.h>
+#include <temp_rule_pool.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wswitch-enum"
@@ -35,19 +37,19 @@ std::variant<std::shared_ptr<Node>, Term> Ast::make_child(const std::shared_ptr<
 	* 			SPECIAL CHILD NODES DUE TO PARENT
 	*/
 	if(*parent == COMPARE_OP_BITWISE_OR_PAIR){
-		return std::make_shared<Compare_op_bitwise_or_pair_child>(str, kind);
+		return make_node<Compare_op_bitwise_or_pair_child>(str, kind);
 	}
 
 	auto factory = [&]() -> std::variant<std::shared_ptr<Node>, Term> {
 
 		switch(kind){
 			case STRING: case INTEGER: case FLOAT:
-				return std::make_shared<Node>(str, kind);
+				return make_node<Node>(str, kind);
 
 			case RESET:
 				context.reset(RL_QUBITS);
 				context.reset(RL_BITS);
-				return std::make_shared<Node>(str, kind);
+				return make_node<Node>(str, kind);
 
 			case CIRCUIT:
 				return context.nn_circuit();
@@ -84,7 +86,7 @@ std::variant<std::shared_ptr<Node>, Term> Ast::make_child(const std::shared_ptr<
 			case GATE_OP:
 				context.reset(RL_QUBITS);
 				context.reset(RL_BITS);
-				return std::make_shared<Node>(str, kind);
+				return make_node<Node>(str, kind);
 
 			case SUBROUTINE_OP:
 				context.reset(RL_QUBITS);
@@ -93,7 +95,7 @@ std::variant<std::shared_ptr<Node>, Term> Ast::make_child(const std::shared_ptr<
 				if(context.current_circuit_uses_subroutines()){
 					return context.nn_subroutine_op();
 				} else {
-					return Term(control.get_rule("gate_op"), GATE_OP, Print_mode::DEFAULT);
+					return Term(control.resolved.gate_op, GATE_OP, Print_mode::DEFAULT);
 				}
 
 			/*
@@ -119,7 +121,7 @@ std::variant<std::shared_ptr<Node>, Term> Ast::make_child(const std::shared_ptr<
 
 				if(res_parent == nullptr){
 					WARNING("Parent of resource expected to be of `Resource` type! Returning dummy");
-					return std::make_shared<Node>("");;
+					return make_node<Node>("");;
 				} else {
 					auto res = res_parent->clone(SHALLOW);
 					res->set_node_kind(kind);
@@ -145,7 +147,7 @@ std::variant<std::shared_ptr<Node>, Term> Ast::make_child(const std::shared_ptr<
 
 				if(def_parent == nullptr){
 					WARNING("Parent of resource def expected to be of `Resource def` type! Returning dummy");
-					return std::make_shared<Node>("");;
+					return make_node<Node>("");;
 				} else {
 					auto def = def_parent->clone(SHALLOW); 
 					def->set_node_kind(kind);
@@ -154,10 +156,10 @@ std::variant<std::shared_ptr<Node>, Term> Ast::make_child(const std::shared_ptr<
 			}
 
 			case PRIMITIVE_GATE:
-				return std::make_shared<Primitive_gate>(context.get_current_circuit());
+				return make_node<Primitive_gate>(context.get_current_circuit());
 
 			case EXPR:
-				return std::make_shared<Node>(str, kind);
+				return make_node<Node>(str, kind);
 
 			case H: case X: case Y: case Z: case T: case TDG: case S: case SDG: case PROJECT_Z:
 			case V: case VDG: case CX : case CY: case CZ: case CNOT: case XX: case YY: case ZZ:
@@ -173,7 +175,7 @@ std::variant<std::shared_ptr<Node>, Term> Ast::make_child(const std::shared_ptr<
 				}
 
 			default:
-				return std::make_shared<Node>(str, kind);
+				return make_node<Node>(str, kind);
 		}
 	};
 
@@ -191,72 +193,146 @@ std::variant<std::shared_ptr<Node>, Term> Ast::make_child(const std::shared_ptr<
 }
 #pragma GCC diagnostic pop
 
+/// One rule expansion in progress: children from the branch picked for a term are added to `parent` one at a time, each child's own
+/// expansion running to completion (as a frame above this one) before the next child is made
+struct Build_frame {
+	std::shared_ptr<Node> parent = nullptr;
+	std::shared_ptr<Expr> term_expr_override = nullptr;
+	unsigned int depth = 0;
+
+	/// held on to, since the branch picked is a reference into it
+	std::shared_ptr<Rule> rule = nullptr;
+	const Branch* branch = nullptr;
+	size_t next_branch_term = 0;
+
+	/// child terms of the branch term being expanded: `n_copies` of `copied_term`, then the terms its expression evaluated to
+	const Term* copied_term = nullptr;
+	unsigned int n_copies = 0;
+	Term stripped_term = {};
+	std::vector<Term> evaluated_terms = {};
+	size_t next_evaluated_term = 0;
+
+	Slot_type last_built_child = nullptr;
+};
+
 /// The parent node passed here is before it has any children, where the children are expected to come from a branch chosen from the rule inside
 /// `term`. Therefore, `parent` and `term` must be the same "kind" 
 /// returns the slot ptr of the last added child node of `parent` when fully built
+/// Expansions are kept on an explicit stack rather than the call stack, so the depth of an AST is limited by `MAX_AST_DEPTH` only
 Slot_type Ast::term_branch_to_child_nodes(
 	std::shared_ptr<Node> parent, 
-	const Term& term, 
+	const Term& term,
 	std::unordered_map<Token_kind, Branch_constraint>& descendant_node_branch_constraints, 
 	std::shared_ptr<Expr> term_expr_override,
 	unsigned int recurr_depth
 ){
+	// a deque, so that frames below the top stay put while frames are pushed
+	std::deque<Build_frame> frames;
 	Slot_type last_built_child = nullptr;
 
-	if (recurr_depth >= QuteFuzz::RECURSION_LIMIT){
-		ERROR("Recursion limit reached when writing branch for term: " + parent->get_str());
-	}
+	auto enter = [&](std::shared_ptr<Node> frame_parent, const Term& frame_term, std::shared_ptr<Expr> frame_override, unsigned int depth){
+		if (depth >= control.resolved.max_ast_depth){
+			ERROR("MAX_AST_DEPTH (" + std::to_string(control.resolved.max_ast_depth) + ") reached when writing branch for term: " + frame_parent->get_str());
+		}
 
-	if (control.step){
-		root->print_ast("");
-		getchar();
-	}
+		if (control.step){
+			root->print_ast("");
+			getchar();
+		}
 
-	if(term.is_rule()){
+		Build_frame& frame = frames.emplace_back(Build_frame{.parent = frame_parent, .term_expr_override = frame_override, .depth = depth});
 
-		Branch branch = term.get_rule()->pick_branch(parent);
+		if (frame_term.is_rule()){
+			frame.rule = frame_term.get_rule();
+			frame.branch = &frame.rule->pick_branch(frame_parent, context.over_budget());
 
-		if ((term_expr_override != nullptr) && (branch.size() > 1)){
-			std::cout << branch << std::endl;
-			ERROR("Term constraints can only be overidden in a branch with one term");
+			if ((frame_override != nullptr) && (frame.branch->size() > 1)){
+				std::cout << *frame.branch << std::endl;
+				ERROR("Term constraints can only be overidden in a branch with one term");
+			}
 		}
+	};
 
-		for(Term& init_child_term : branch){
-			if (term_expr_override != nullptr){
-				init_child_term.add_expr(term_expr_override);
-			}
+	auto expand_branch_term = [&](Build_frame& frame){
+		const Term& branch_term = frame.branch->at(frame.next_branch_term++);
+		const std::shared_ptr<Expr>& expr = (frame.term_expr_override != nullptr) ? frame.term_expr_override : branch_term.get_expr();
 
-			auto term_expr_eval = init_child_term.eval_expr(context);
-			
-			for (const Term& child_term : term_expr_eval){
-				auto maybe_child = make_child(parent, child_term);
+		frame.evaluated_terms.clear();
+		frame.next_evaluated_term = 0;
 
-				if(std::holds_alternative<Term>(maybe_child)){
-					// redirect
-					term_branch_to_child_nodes(parent, std::get<Term>(maybe_child), descendant_node_branch_constraints, term_expr_override, recurr_depth);
-				
-				} else {
-					std::shared_ptr<Node> child_node = std::get<std::shared_ptr<Node>>(maybe_child);
-					Token_kind child_node_kind = child_node->get_node_kind();
+		if (expr == nullptr){
+			frame.copied_term = &branch_term;
+			frame.n_copies = 1;
 
-					auto it = descendant_node_branch_constraints.find(child_node_kind);
+		} else if (const Expr_code* code = expr->get_code()){
+			// the expression only asks for a number of copies of the term, so build them straight from one copy without its expression
+			frame.n_copies = branch_term.repeat_count(code->run(context));
+			frame.stripped_term = branch_term;
+			frame.stripped_term.add_expr(nullptr);
+			frame.copied_term = &frame.stripped_term;
 
-					if (it != descendant_node_branch_constraints.end()){
-						// INFO("Adding descendant branch constraint to node " + child_node->get_str());
-						// need to add a branch constraint to this child node, then remove it from the map
-						child_node->add_branch_constraint(it->second);
-					}
+		} else if (frame.term_expr_override != nullptr){
+			Term init_child_term = branch_term;
+			init_child_term.add_expr(frame.term_expr_override);
+			frame.evaluated_terms = init_child_term.eval_expr(context);
 
-					last_built_child = parent->add_child(child_node);
-					term_branch_to_child_nodes(child_node, child_term, descendant_node_branch_constraints, nullptr, recurr_depth + 1);
-				}
+		} else {
+			frame.evaluated_terms = branch_term.eval_expr(context);
+		}
+	};
+
+	enter(parent, term, term_expr_override, recurr_depth);
 
+	while (!frames.empty()){
+		Build_frame& frame = frames.back();
+		const Term* child_term = nullptr;
+
+		if (frame.n_copies > 0){
+			frame.n_copies--;
+			child_term = frame.copied_term;
+
+		} else if (frame.next_evaluated_term < frame.evaluated_terms.size()){
+			child_term = &frame.evaluated_terms[frame.next_evaluated_term++];
+
+		} else if ((frame.branch != nullptr) && (frame.next_branch_term < frame.branch->size())){
+			expand_branch_term(frame);
+			continue;
+
+		} else {
+			// done
+			frame.parent->transition_to_done();
+
+			if (frames.size() == 1){
+				last_built_child = frame.last_built_child;
 			}
+
+			frames.pop_back();
+			continue;
 		}
-	}
 
-	// done
-	parent->transition_to_done();
+		auto maybe_child = make_child(frame.parent, *child_term);
+
+		if(std::holds_alternative<Term>(maybe_child)){
+			// redirect
+			enter(frame.parent, std::get<Term>(maybe_child), frame.term_expr_override, frame.depth);
+		
+		} else {
+			std::shared_ptr<Node> child_node = std::get<std::shared_ptr<Node>>(maybe_child);
+			Token_kind child_node_kind = child_node->get_node_kind();
+
+			auto it = descendant_node_branch_constraints.find(child_node_kind);
+
+			if (it != descendant_node_branch_constraints.end()){
+				// INFO("Adding descendant branch constraint to node " + child_node->get_str());
+				// need to add a branch constraint to this child node, then remove it from the map
+				child_node->add_branch_constraint(it->second);
+			}
+
+			frame.last_built_child = frame.parent->add_child(child_node);
+			context.charge_node(child_term->syntax_size());
+			enter(child_node, *child_term, nullptr, frame.depth + 1);
+		}
+	}
 
 	return last_built_child;
 }
@@ -266,9 +342,10 @@ std::shared_ptr<Node> Ast::build(std::shared_ptr<Rule> entry, std::unordered_map
 		ERROR("Entry point not set");
 
 	} else {
+		Temp_rule_pool::Build_scope temp_rules;
 		const Term& entry_term = make_term_from_rule(entry);
 
-		auto maybe_root = make_child(std::make_shared<Node>("", RULE), entry_term); // need this call such that the entry node also calls the factory function
+		auto maybe_root = make_child(make_node<Node>("", RULE), entry_term); // need this call such that the entry node also calls the factory function
 
 		if(std::holds_alternative<std::shared_ptr<Node>>(maybe_root)){
 			root = std::get<std::shared_ptr<Node>>(maybe_root);
@@ -11,16 +11,20 @@ void Context::reset(Reset_level l){
     switch(l){
         case RL_PROGRAM: {
             subroutine_counter = 0;
+            next_resource_id = 1;
             Node::node_counter = 0;
 
             circuits.clear();
+            invalidate_applicable_subroutines();
 
             subroutine_defs_node = nullptr;
+
+            start_budget();
             [[fallthrough]];
         }
 
         case RL_CIRCUIT:
-            nested_depth = control.get_value("NESTED_MAX_DEPTH");
+            nested_depth = control.resolved.nested_max_depth;
             total_times_used = {
                 {Resource_kind::QUBIT, 0},
                 {Resource_kind::BIT, 0},
@@ -42,6 +46,72 @@ void Context::reset(Reset_level l){
     }
 }
 
+void Context::start_budget(){
+    budget_nodes = 0;
+    budget_bytes = 0;
+    budget_start = std::chrono::steady_clock::now();
+    budget_spent = false;
+}
+
+void Context::charge_node(size_t n_bytes){
+    budget_nodes++;
+    budget_bytes += n_bytes;
+
+    if (budget_spent) return;
+
+    const char* spent = nullptr;
+
+    if (budget_nodes > control.resolved.max_ast_nodes){
+        spent = "MAX_AST_NODES";
+
+    } else if (budget_bytes > control.resolved.max_ast_bytes){
+        spent = "MAX_AST_BYTES";
+
+    } else if (!control.step && (budget_nodes % 256 == 0)){
+        // reading the clock is the costly check, so only do it every so often
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - budget_start);
+
+        if (elapsed.count() > control.resolved.max_ast_millis){
+            spent = "MAX_AST_MILLIS";
+        }
+    }
+
+    if (spent != nullptr){
+        budget_spent = true;
+        WARNING("AST " + std::to_string(ast_id) + " is over its " + spent + " budget, finishing it with the shortest branches");
+    }
+}
+
+std::shared_ptr<Context> Context::fork(Clone_map& copies) const {
+    auto forked = std::make_shared<Context>(*this);
+
+    for (auto& circuit : forked->circuits){
+        circuit = relinked(circuit, copies);
+    }
+
+    forked->dummy_circuit = relinked(dummy_circuit, copies);
+    forked->current.relink(copies);
+
+    for (auto& [var, bound] : forked->resource_var_bindings){
+        for (auto& resource : bound){
+            resource = relinked(resource, copies);
+        }
+    }
+
+    for (auto& [var, bound] : forked->resource_def_var_bindings){
+        for (auto& def : bound){
+            def = relinked(def, copies);
+        }
+    }
+
+    forked->subroutine_defs_node = relinked(subroutine_defs_node, copies);
+
+    // worked out for a circuit of the source
+    forked->invalidate_applicable_subroutines();
+
+    return forked;
+}
+
 /// @brief Check whether current circuit can apply `circuit` as a subroutine
 /// @param dest
 /// @param circuit
@@ -60,8 +130,7 @@ bool Context::can_apply_as_subroutine(const std::shared_ptr<Circuit> circuit){
     };
 
     for (auto rk : hungry_resources){
-        auto current_circuit_resources = current_circuit->get_coll<Resource>(rk);
-        unsigned int current_circuit_n_resources = current_circuit_resources.size();
+        unsigned int current_circuit_n_resources = current_circuit->get_coll<Resource>(rk).size();
 
         unsigned int required_n_resources = 0;
 
@@ -70,11 +139,8 @@ bool Context::can_apply_as_subroutine(const std::shared_ptr<Circuit> circuit){
         }
 
         if (circuit->get_node_kind() == SUB_CIRCUIT){
-            auto ext_scope_pred = [](const auto& elem){ return scope_matches(elem->get_scope(), Scope::EXT); };
-            auto circuit_resources = circuit->get_coll<Resource>(rk);
-        
-            required_n_resources = size_pred<Resource>(circuit_resources, ext_scope_pred);
-        
+            required_n_resources = circuit->get_n_resources(rk, Scope::EXT);
+
         } else {
             required_n_resources = (rk == Resource_kind::QUBIT) ? circuit->get_n_matrix_qubits() : 0;
         }
@@ -87,84 +153,83 @@ bool Context::can_apply_as_subroutine(const std::shared_ptr<Circuit> circuit){
     return true;
 }
 
-bool Context::current_circuit_uses_subroutines(){
-    for(std::shared_ptr<Circuit> circuit : circuits){
-        if (can_apply_as_subroutine(circuit)){
-            return true;
-        }
+/// Applicability only changes when a circuit is added, a resource def is stored or the current circuit changes, so it is worked out once per
+/// such change rather than at every subroutine op
+void Context::update_applicable_subroutines(){
+    const Circuit* current_circuit = get_current_circuit().get();
+
+    if (applicable_subroutines_valid && (applicable_subroutines_for == current_circuit)){
+        return;
     }
 
-    return false;
+    applicable_subroutines.assign(circuits.size(), false);
+    n_applicable_subroutines = 0;
+
+    for (size_t i = 0; i < circuits.size(); i++){
+        applicable_subroutines[i] = can_apply_as_subroutine(circuits[i]);
+        n_applicable_subroutines += applicable_subroutines[i];
+    }
+
+    applicable_subroutines_for = current_circuit;
+    applicable_subroutines_valid = true;
+}
+
+bool Context::current_circuit_uses_subroutines(){
+    update_applicable_subroutines();
+    return n_applicable_subroutines > 0;
 }
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wswitch-enum"
 #pragma GCC diagnostic ignored "-Wswitch"
-Expr_type Context::resolve_var(const Token_kind name, const std::vector<Expr_type>& args) const {
-    auto gate = get_current_node<Gate>();
+bool Context::is_scalar_var(const Token_kind name){
+    switch(name){
+        case MAKE_FLOAT: case MAKE_INTEGER: case GET_CIRCUIT_KIND: case GET_SIZE: case GET_INDEX: case GET_GATE_SOURCE:
+        case GET_GATE_QUBITS: case GET_GATE_BITS: case GET_GATE_PARAMS: case GET_TOTAL_QUBITS: case GET_TOTAL_BITS:
+        case UNIFORM: case GET_CIRCUIT_ID:
+            return true;
+        default:
+            return false;
+    }
+}
 
+Scalar Context::resolve_scalar_var(const Token_kind name, const Scalar* args, size_t n_args) const {
     switch(name){
         case MAKE_FLOAT:
             return uniform_float(10.0, 0.0);
 
-        case MAKE_VAR:
-            return uniform_str(5);
-
         case MAKE_INTEGER:
             return (int)uniform_uint(10, 0);
 
-        case GET_CIRCUIT_NAME:
-            return get_current_circuit()->get_name();
-
         case GET_CIRCUIT_KIND:
             return get_current_circuit()->get_node_kind();
 
-        case GET_GATE_NAME:
-            return gate->get_str();
-
-        case GET_DEF_NAME:
-            return get_current_node<Resource_def>()->get_var_name();
-
         case GET_SIZE:
             return (int)get_current_node<Resource_def>()->get_size();
 
-        case GET_DECL_NAME:
-            return get_current_node<Resource>()->get_var_name();
-
         case GET_INDEX:
             return (int)get_current_node<Resource>()->get_index();
 
         case GET_GATE_SOURCE:
-            return gate->get_gate_source();
+            return get_current_node<Gate>()->get_gate_source();
 
         case GET_GATE_QUBITS:
-            return (int)gate->get_num_external_resources(Resource_kind::QUBIT);
+            return (int)get_current_node<Gate>()->get_num_external_resources(Resource_kind::QUBIT);
 
         case GET_GATE_BITS:
-            return (int)gate->get_num_external_resources(Resource_kind::BIT);
+            return (int)get_current_node<Gate>()->get_num_external_resources(Resource_kind::BIT);
 
         case GET_GATE_PARAMS:
-            return (int)gate->get_num_external_resources(Resource_kind::PARAM);
+            return (int)get_current_node<Gate>()->get_num_external_resources(Resource_kind::PARAM);
 
-        case GET_TOTAL_QUBITS: {
-            auto qubits = get_current_circuit()->get_coll<Resource>(Resource_kind::QUBIT);
-            return (int)qubits.size();
-        }
+        case GET_TOTAL_QUBITS:
+            return (int)get_current_circuit()->get_coll<Resource>(Resource_kind::QUBIT).size();
 
-        case GET_TOTAL_BITS: {
-            auto bits = get_current_circuit()->get_coll<Resource>(Resource_kind::BIT);
-            return (int)bits.size();
-        }
-
-        case GET_MAT_POS:
-            if ((args.size() == 2) && 
-                std::holds_alternative<int>(args[0]) && std::holds_alternative<int>(args[1])) {
-                return get_current_circuit()->get_val_at(std::get<int>(args[0]), std::get<int>(args[1]));
-            }
-            break;
+        case GET_TOTAL_BITS:
+            return (int)get_current_circuit()->get_coll<Resource>(Resource_kind::BIT).size();
 
         case UNIFORM:
-            if ((args.size() == 2)) {
+            if (n_args == 2) {
                 if (std::holds_alternative<int>(args[0]) && std::holds_alternative<int>(args[1])){
                     auto arg0 = std::get<int>(args[0]);
                     auto arg1 = std::get<int>(args[1]);
@@ -181,6 +246,57 @@ Expr_type Context::resolve_var(const Token_kind name, const std::vector<Expr_typ
             }
             break;
 
+        case GET_CIRCUIT_ID:
+            return ast_id;
+    }
+
+    return 0;
+}
+
+Expr_type Context::resolve_var(const Token_kind name, const std::vector<Expr_type>& args) const {
+    if (is_scalar_var(name)){
+        std::vector<Scalar> scalar_args;
+
+        for (const Expr_type& arg : args){
+            if (std::holds_alternative<int>(arg)){
+                scalar_args.push_back(std::get<int>(arg));
+            } else if (std::holds_alternative<bool>(arg)){
+                scalar_args.push_back(std::get<bool>(arg));
+            } else if (std::holds_alternative<float>(arg)){
+                scalar_args.push_back(std::get<float>(arg));
+            } else {
+                ERROR("ARGS to " + kind_as_str(name) + " must resolve to int, bool or float");
+            }
+        }
+
+        return to_expr_type(resolve_scalar_var(name, scalar_args.data(), scalar_args.size()));
+    }
+
+    auto gate = get_current_node<Gate>();
+
+    switch(name){
+        case MAKE_VAR:
+            return uniform_str(5);
+
+        case GET_CIRCUIT_NAME:
+            return get_current_circuit()->get_name();
+
+        case GET_GATE_NAME:
+            return gate->get_str();
+
+        case GET_DEF_NAME:
+            return get_current_node<Resource_def>()->get_var_name();
+
+        case GET_DECL_NAME:
+            return get_current_node<Resource>()->get_var_name();
+
+        case GET_MAT_POS:
+            if ((args.size() == 2) && 
+                std::holds_alternative<int>(args[0]) && std::holds_alternative<int>(args[1])) {
+                return get_current_circuit()->get_val_at(std::get<int>(args[0]), std::get<int>(args[1]));
+            }
+            break;
+
         case AST_HAS_NODE:
             if (args.size() == 1) {
                 if (std::holds_alternative<std::shared_ptr<Rule>>(args[0])){
@@ -202,8 +318,6 @@ Expr_type Context::resolve_var(const Token_kind name, const std::vector<Expr_typ
             }
             break;
 
-        case GET_CIRCUIT_ID:
-            return ast_counter;
     }
 
     return 0;
@@ -223,23 +337,15 @@ std::shared_ptr<Circuit> Context::get_current_circuit() const {
 
 std::shared_ptr<Circuit> Context::get_random_circuit(){
 
-    bool valid_circuit_exists = false;
-    for (const auto& circuit : circuits) {
-        if (can_apply_as_subroutine(circuit)) {
-            valid_circuit_exists = true;
-            break;
-        }
-    }
-
-    if(circuits.size() && valid_circuit_exists){
+    if(current_circuit_uses_subroutines()){
 
-        std::shared_ptr<Circuit> circuit = circuits.at(uniform_uint(circuits.size()-1));
+        size_t i = uniform_uint(circuits.size()-1);
 
-        while(!can_apply_as_subroutine(circuit)){
-            circuit = circuits.at(uniform_uint(circuits.size()-1));
+        while(!applicable_subroutines[i]){
+            i = uniform_uint(circuits.size()-1);
         }
 
-        return circuit;
+        return circuits[i];
 
     } else {
         ERROR("No available circuits to use as subroutines!");
@@ -249,15 +355,8 @@ std::shared_ptr<Circuit> Context::get_random_circuit(){
 
 
 std::shared_ptr<Resource> Context::get_random_resource(Resource_kind rk, Scope scope){
-    Ptr_pred_type<Resource> pred = [](const std::shared_ptr<Resource>& elem){ return !elem->is_used(); };
-
-    auto filtered_coll = (scope == Scope::GLOB) ?
-        dummy_circuit->get_coll<Resource>(rk) :
-        get_current_circuit()->get_coll<Resource>(rk);
-
-    // auto random_resource = get_random_from_coll<Resource>(filtered_coll, pred);
-    auto random_resource = get_biased_random_from_coll(filtered_coll, pred, total_times_used[rk]++);
-    random_resource->set_used();
+    std::shared_ptr<Circuit> circuit = (scope == Scope::GLOB) ? dummy_circuit : get_current_circuit();
+    auto random_resource = circuit->use_random_resource(rk, total_times_used[rk]++);
 
     current.set<Resource>(random_resource);
     return random_resource;
@@ -270,18 +369,8 @@ std::shared_ptr<Resource_def> Context::nn_resource_def(Scope& scope, Resource_ki
     // decide whether to treat def as a register or singular definition
     bool can_use_reg, can_use_sing, is_reg;
 
-    if(rk == Resource_kind::QUBIT){
-        can_use_reg = !control.get_rule("register_qubit_def", scope)->is_empty();
-        can_use_sing = !control.get_rule("singular_qubit_def", scope)->is_empty();
-    } else if(rk == Resource_kind::BIT){
-        can_use_reg = !control.get_rule("register_bit_def", scope)->is_empty();
-        can_use_sing = !control.get_rule("singular_bit_def", scope)->is_empty();
-    } else if (rk == Resource_kind::PARAM){
-        can_use_reg = !control.get_rule("register_param_def", scope)->is_empty();
-        can_use_sing = !control.get_rule("singular_param_def", scope)->is_empty();
-    } else {
-        ERROR("Unknown resource kind!");
-    }
+    can_use_reg = control.resolved.can_define_reg(rk, scope);
+    can_use_sing = control.resolved.can_define_sing(rk, scope);
 
     if (can_use_reg && can_use_sing){
         is_reg = uniform_uint(1, 0);
@@ -291,38 +380,42 @@ std::shared_ptr<Resource_def> Context::nn_resource_def(Scope& scope, Resource_ki
         is_reg = false;
     }
 
-    def = std::make_shared<Resource_def>(scope, rk, is_reg, uniform_uint(control.get_value("MAX_REG_SIZE"), 1));
+    def = make_node<Resource_def>(scope, rk, is_reg, uniform_uint(control.resolved.max_reg_size, 1));
 
     current.set<Resource_def>(def);
-    get_current_circuit()->store_resource_def(def);
+    get_current_circuit()->store_resource_def(def, next_resource_id);
+    invalidate_applicable_subroutines();
 
     return def;
 }
 
 std::shared_ptr<Circuit> Context::nn_circuit(){
     reset(RL_CIRCUIT);
-    std::shared_ptr<Circuit> current_circuit = std::make_shared<Circuit>(QuteFuzz::TOP_LEVEL_CIRCUIT_NAME, CIRCUIT);
+    std::shared_ptr<Circuit> current_circuit = make_node<Circuit>(QuteFuzz::TOP_LEVEL_CIRCUIT_NAME, CIRCUIT);
     subroutine_counter = 0;
     circuits.push_back(current_circuit);
+    invalidate_applicable_subroutines();
     return current_circuit;
 }
 
 std::shared_ptr<Circuit> Context::nn_sub_circuit(){
     reset(RL_CIRCUIT);
-    std::shared_ptr<Circuit> current_circuit = std::make_shared<Circuit>("sub_" + std::to_string(subroutine_counter++), SUB_CIRCUIT);
+    std::shared_ptr<Circuit> current_circuit = make_node<Circuit>("sub_" + std::to_string(subroutine_counter++), SUB_CIRCUIT);
     circuits.push_back(current_circuit);
+    invalidate_applicable_subroutines();
     return current_circuit;
 }
 
 std::shared_ptr<Circuit> Context::nn_unitary(unsigned int n_qubits){
     reset(RL_CIRCUIT);
-    std::shared_ptr<Circuit> current_circuit = std::make_shared<Circuit>("unitary_" + std::to_string(subroutine_counter++), n_qubits);
+    std::shared_ptr<Circuit> current_circuit = make_node<Circuit>("unitary_" + std::to_string(subroutine_counter++), n_qubits);
     circuits.push_back(current_circuit);
+    invalidate_applicable_subroutines();
     return current_circuit;
 }
 
 std::shared_ptr<Gate> Context::nn_gate(const std::string& str, const Token_kind& kind){
-    auto gate = std::make_shared<Gate>(str, kind);
+    auto gate = make_node<Gate>(str, kind);
 
     current.set<Gate>(gate);
     current.get<Qubit_op>()->set_gate_node(gate);
@@ -345,10 +438,10 @@ std::shared_ptr<Gate> Context::nn_subroutine_op(){
     std::shared_ptr<Gate> gate;
 
     if (circ_kind == SUB_CIRCUIT){
-        gate = std::make_shared<Gate>(gate_name, sub_circuit->get_coll<Resource_def>());
+        gate = make_node<Gate>(gate_name, sub_circuit->get_resource_defs());
 
     } else if ((circ_kind == UNITARY_1Q_DEF) || (circ_kind == UNITARY_2Q_DEF)){
-        gate = std::make_shared<Gate>(gate_name, sub_circuit->get_n_matrix_qubits());
+        gate = make_node<Gate>(gate_name, sub_circuit->get_n_matrix_qubits());
 
     } else {
         ERROR("Cannot create gate from node of kind " + kind_as_str(circ_kind));
@@ -363,11 +456,11 @@ std::shared_ptr<Gate> Context::nn_subroutine_op(){
 }
 
 std::shared_ptr<Compound_stmt> Context::nn_compound_stmt(){
-    return std::make_shared<Compound_stmt>(nested_depth);
+    return make_node<Compound_stmt>(nested_depth);
 }
 
 std::shared_ptr<Node> Context::nn_subroutine_defs(){
-    subroutine_defs_node = std::make_shared<Node>("", SUBROUTINE_DEFS);
+    subroutine_defs_node = make_node<Node>("", SUBROUTINE_DEFS);
     return subroutine_defs_node;
 }
 
@@ -375,7 +468,7 @@ std::shared_ptr<Qubit_op> Context::nn_qubit_op(){
     reset(RL_QUBITS);
     reset(RL_BITS);
 
-    auto qubit_op = std::make_shared<Qubit_op>(get_current_circuit()->get_name());
+    auto qubit_op = make_node<Qubit_op>(get_current_circuit()->get_name());
     current.set<Qubit_op>(qubit_op);
     return qubit_op;
 }
@@ -1,141 +1,284 @@
 #include <node.h>
 #include <ast_utils.h>
 
-int Node::node_counter = 0;
+thread_local int Node::node_counter = 0;
 
-std::shared_ptr<Node> Node::clone(const Clone_type& ct) const {
-    auto new_node = std::make_shared<Node>(*this);
+/// A node that is the last owner of a child with children of its own takes those over, and so on down, so that each node is released
+/// holding only leaves or nodes owned elsewhere. The outermost node being released does all of the work, in one loop
+Node::~Node(){
+    std::vector<std::shared_ptr<Node>> pending;
+
+    auto take_over = [&pending](Node_children& children){
+        for(std::shared_ptr<Node>& child : children){
+            if((child.use_count() == 1) && !child->children.empty()){
+                pending.push_back(std::move(child));
+            }
+        }
+    };
+
+    take_over(children);
+
+    while(!pending.empty()){
+        std::shared_ptr<Node> node = std::move(pending.back());
+        pending.pop_back();
+
+        take_over(node->children);
+    }
+}
+
+std::shared_ptr<Node> Node::shallow_copy() const {
+    auto new_node = make_node<Node>(*this);
     new_node->children.clear();
     new_node->incr_id();
 
-    if (ct == DEEP){
-        for (const auto& child : children) {
-            new_node->children.push_back(child->clone(ct));
-        }
+    return new_node;
+}
+
+std::shared_ptr<Node> Node::clone(const Clone_type& ct) const {
+    return (ct == DEEP) ? copy_tree(nullptr, nullptr) : shallow_copy();
+}
+
+/// Links are only followed once the whole tree is copied, so that a link to any node of the tree finds its copy rather than copying it again
+std::shared_ptr<Node> Node::clone(Clone_map& copies) const {
+    std::vector<Node*> made;
+    std::shared_ptr<Node> new_node = copy_tree(&copies, &made);
+
+    new_node->relink(copies);
+
+    for (Node* copy : made){
+        copy->relink(copies);
     }
 
     return new_node;
 }
 
-/// Used to print the program
-void Node::print_program(std::ostream& stream, unsigned int indent_level) const {
-    switch(print_mode) {
-        case Print_mode::CHILD_INDENT: {
-            unsigned int inner = indent_level + 1;
-            std::string tabs(inner, '\t');
-            for(const auto& child : children) {
-                stream << tabs;
-                child->print_program(stream, inner);
+/// Nodes are copied in pre-order, as they were when cloning recursed, so that they are given the same ids
+std::shared_ptr<Node> Node::copy_tree(Clone_map* copies, std::vector<Node*>* made) const {
+    std::shared_ptr<Node> new_node = shallow_copy();
+
+    if (copies != nullptr){
+        copies->emplace(this, new_node);
+    }
+
+    // node to copy, and the copy to attach it to
+    std::vector<std::pair<const Node*, Node*>> stack;
+
+    for (auto it = children.rbegin(); it != children.rend(); ++it){
+        stack.push_back({it->get(), new_node.get()});
+    }
+
+    while (!stack.empty()){
+        auto [node, copy_parent] = stack.back();
+        stack.pop_back();
+
+        std::shared_ptr<Node> copy = node->shallow_copy();
+        copy_parent->add_child(copy);
+
+        if (copies != nullptr){
+            made->push_back(copy.get());
+
+            if (node->linkable()){
+                copies->emplace(node, copy);
             }
-            return;
         }
-        case Print_mode::SELF_INDENT: {
-            std::string tabs(indent_level, '\t');
-            stream << tabs;
-            for(const auto& child : children)
-                child->print_program(stream, indent_level);
-            return;
+
+        for (auto it = node->children.rbegin(); it != node->children.rend(); ++it){
+            stack.push_back({it->get(), copy.get()});
+        }
+    }
+
+    return new_node;
+}
+
+/// Used to print the program. The program is written into a buffer owned by the thread, which keeps its capacity between programs,
+/// and then handed to the stream in a single write
+void Node::print_program(std::ostream& stream) const {
+    thread_local std::string buffer;
+
+    buffer.clear();
+    write_program(buffer);
+
+    stream.write(buffer.data(), buffer.size());
+}
+
+void Node::write_program(std::string& out, unsigned int indent_level) const {
+    struct Write_frame {
+        const Node* node;
+        unsigned int indent_level;
+        size_t next_child;
+    };
+
+    std::vector<Write_frame> stack;
+
+    if(write_head(out, indent_level)){
+        stack.push_back({this, indent_level, 0});
+    }
+
+    while(!stack.empty()){
+        Write_frame& frame = stack.back();
+        const Node* node = frame.node;
+
+        if(frame.next_child > 0){
+            node->write_child_suffix(out);
+        }
+
+        if(frame.next_child == node->children.size()){
+            stack.pop_back();
+            continue;
         }
-        case Print_mode::INDENT_LEVEL: {
-            stream << indent_level;
-            return;
+
+        const Node* child = node->children[frame.next_child++].get();
+        unsigned int child_indent_level = frame.indent_level;
+
+        if(node->print_mode == Print_mode::CHILD_INDENT){
+            child_indent_level++;
+            out.append(child_indent_level, '\t');
         }
-        case Print_mode::DEFAULT: {
-            if(kind == STRING || kind == INTEGER || kind == FLOAT) stream << str;
-            else for(const auto& child : children)
-                child->print_program(stream, indent_level);
-            return;
+
+        // `frame` is not used past this point, as pushing may reallocate the stack
+        if(child->write_head(out, child_indent_level)){
+            stack.push_back({child, child_indent_level, 0});
         }
-        default:
-            stream << str;
     }
 }
 
-bool Node::visited(std::vector<Slot_type>& visited_slots, Slot_type slot, bool track_visited) const {
-    for(auto vslot : visited_slots){
-        if(vslot == slot) return true;
+bool Node::write_head(std::string& out, unsigned int indent_level) const {
+    switch(print_mode) {
+        case Print_mode::CHILD_INDENT:
+            return true;
+
+        case Print_mode::SELF_INDENT:
+            out.append(indent_level, '\t');
+            return true;
+
+        case Print_mode::INDENT_LEVEL:
+            out += std::to_string(indent_level);
+            return false;
+
+        case Print_mode::DEFAULT:
+            if(kind == STRING || kind == INTEGER || kind == FLOAT){
+                out += str;
+                return false;
+            }
+            return true;
     }
 
-    if(track_visited) visited_slots.push_back(slot);
+    out += str;
     return false;
 }
 
-Slot_type Node::find_slot(Token_kind node_kind, std::vector<Slot_type>& visited_slots, bool track_visited) {
-    Slot_type maybe_find;
+template<typename Pred>
+Slot_type Node::find_slot_if(Pred pred){
+    std::vector<Slot_type> stack;
+
+    for(auto it = children.rbegin(); it != children.rend(); ++it){
+        stack.push_back(&*it);
+    }
+
+    while(!stack.empty()){
+        Slot_type slot = stack.back();
+        stack.pop_back();
 
-    for(std::shared_ptr<Node>& child : children){
-        if((child->get_node_kind() == node_kind) && !visited(visited_slots, &child, track_visited)){
-            return &child;
+        if(pred(**slot)){
+            return slot;
         }
 
-        maybe_find = child->find_slot(node_kind, visited_slots, track_visited);
-        if(maybe_find != nullptr) return maybe_find;
+        Node_children& below = (*slot)->children;
+
+        for(auto it = below.rbegin(); it != below.rend(); ++it){
+            stack.push_back(&*it);
+        }
     }
 
     return nullptr;
 }
 
-/// Find first occurance of node of node_kind. Therefore, does NOT mark visited nodes
+/// Slot of first node of node_kind below this one, in pre-order
+Slot_type Node::find_slot(Token_kind node_kind) {
+    return find_slot_if([node_kind](const Node& node){return node.get_node_kind() == node_kind;});
+}
+
+/// Find first occurance of node of node_kind
 std::shared_ptr<Node> Node::find(Token_kind node_kind) {
     if(kind == node_kind){
         return shared_from_this();
     }
 
-    std::vector<Slot_type> visited_slots = {};
-    Slot_type maybe_find = find_slot(node_kind, visited_slots, false);
+    Slot_type maybe_find = find_slot(node_kind);
 
     return (maybe_find == nullptr) ? nullptr : *maybe_find;
 }
 
-Slot_type Node::find_slot(std::string node_name, std::vector<Slot_type>& visited_slots, bool track_visited) {
-    Slot_type maybe_find;
-
-    for(std::shared_ptr<Node>& child : children){
-        if((child->get_str() == node_name) && !visited(visited_slots, &child, track_visited)){
-            return &child;
-        }
-
-        maybe_find = child->find_slot(node_name, visited_slots, track_visited);
-        if(maybe_find != nullptr) return maybe_find;
-    }
-
-    return nullptr;
+/// Slot of first node named node_name below this one, in pre-order
+Slot_type Node::find_slot(const std::string& node_name) {
+    return find_slot_if([&node_name](const Node& node){return node.get_str() == node_name;});
 }
 
-/// Find first occurance of node of node_name. Therefore, does NOT mark visited nodes
+/// Find first occurance of node of node_name
 std::shared_ptr<Node> Node::find(std::string node_name) {
     if(str == node_name){
         return shared_from_this();
     }
 
-    std::vector<Slot_type> visited_slots = {};
-    Slot_type maybe_find = find_slot(node_name, visited_slots, false);
+    Slot_type maybe_find = find_slot(node_name);
 
     return (maybe_find == nullptr) ? nullptr : *maybe_find;
 }
 
+/// Slot holding `child`, trying its index hint before scanning the children
+Slot_type Node::slot_of_child(const Node* child) {
+    size_t hint = child->index_in_parent;
+
+    if((hint < children.size()) && (children[hint].get() == child)){
+        return &children[hint];
+    }
+
+    for(std::shared_ptr<Node>& maybe_child : children){
+        if(maybe_child.get() == child) return &maybe_child;
+    }
+
+    return nullptr;
+}
 
 void Node::print_ast(std::string indent) const {
-    std::cout << indent << BOLD(YELLOW(str)) << " " <<  GREY(kind_as_str(kind)) << " (" << this << ")" << " n_children: " << children.size() << std::endl;
+    std::vector<std::pair<const Node*, std::string>> stack = {{this, indent}};
+
+    while(!stack.empty()){
+        auto [node, node_indent] = std::move(stack.back());
+        stack.pop_back();
+
+        std::cout << node_indent << BOLD(YELLOW(node->str)) << " " <<  GREY(kind_as_str(node->kind)) << " (" << node << ")" << " n_children: " << node->children.size() << std::endl;
 
-    for(const std::shared_ptr<Node>& child : children){
-        child->print_ast(indent + "   ");
+        for(auto it = node->children.rbegin(); it != node->children.rend(); ++it){
+            stack.push_back({it->get(), node_indent + "   "});
+        }
     }
 }
 
 void Node::extend_dot_string(std::ostringstream& ss) const {
+    // edge to draw, from parent to child, in the order the recursive walk drew them
+    std::vector<std::pair<const Node*, const Node*>> stack;
+
+    for(auto it = children.rbegin(); it != children.rend(); ++it){
+        stack.push_back({this, it->get()});
+    }
+
+    while(!stack.empty()){
+        auto [node, child] = stack.back();
+        stack.pop_back();
 
-    for(const std::shared_ptr<Node>& child : children){
         if((child->get_node_kind() != STRING) && (child->get_node_kind() != INTEGER) && (child->get_node_kind() != FLOAT)){
             int child_id = child->get_id();
 
-            ss << "  " << id << " [label=\"" << get_str() << "\"];" << std::endl;
+            ss << "  " << node->id << " [label=\"" << node->get_str() << "\"];" << std::endl;
             ss << "  " << child_id << " [label=\"" << child->get_str() << "\"];" << std::endl;
 
-            ss << "  " << id << " -> " << child_id << ";" << std::endl;
+            ss << "  " << node->id << " -> " << child_id << ";" << std::endl;
         }
 
-        child->extend_dot_string(ss);
+        for(auto it = child->children.rbegin(); it != child->children.rend(); ++it){
+            stack.push_back({child, it->get()});
+        }
     }
 }
 
@@ -1,48 +1,68 @@
 #include <circuit.h>
 #include <rule.h>
-#include <iomanip>
-#include <sstream>
-
-/// Box-Muller normal sample
-static double box_muller() {
-    double u1 = std::max(uniform_float(1.0f, 0.0f), 1e-7f);
-    double u2 = uniform_float(1.0f, 0.0f);
-    return std::sqrt(-2.0f * std::log(u1)) * std::cos(2.0f * std::numbers::pi * u2);
-}
+#include <charconv>
+#include <random>
+
+/// @brief Haar random N x N unitary, written row-major into `out`. Columns of a matrix of complex normal samples are reduced by Householder
+/// reflections, and the phases of R's diagonal are moved onto Q, so that Q is drawn from the Haar measure rather than biased by the QR
+template<unsigned int N>
+static void haar_unitary(Cx* out) {
+    std::normal_distribution<double> normal(0.0, std::numbers::sqrt2 / 2.0);
+
+    std::array<Cx, N * N> a;
+    for (Cx& c : a){
+        double re = normal(rng());
+        c = Cx(re, normal(rng()));
+    }
+
+    // q starts as the identity, and each reflection is applied to it on the right
+    std::array<Cx, N * N> q{};
+    for (unsigned int i = 0; i < N; i++) q[i * N + i] = 1.0;
+
+    std::array<Cx, N> phase;
+    std::array<Cx, N> v;
+
+    for (unsigned int k = 0; k < N; k++) {
+        double x_norm = 0.0;
+        for (unsigned int i = k; i < N; i++) x_norm += std::norm(a[i * N + k]);
+        x_norm = std::sqrt(x_norm);
+
+        Cx x0 = a[k * N + k];
+        Cx x0_phase = (std::abs(x0) > 0.0) ? (x0 / std::abs(x0)) : Cx(1.0);
 
-/// Gram-Schmidt column orthogonalisation to make unitary matrix
-static CxMat haar_unitary(unsigned int n) {
-    CxMat src(n, std::vector<Cx>(n));
-    for (auto& row : src)
-        for (auto& c : row)
-            c = Cx(box_muller(), box_muller());
-
-    CxMat q(n, std::vector<Cx>(n));
-
-    for (unsigned int j = 0; j < n; j++) {
-        std::vector<Cx> col(n);
-        for (unsigned int i = 0; i < n; i++) col[i] = src[i][j];
-
-        // subtract projections onto previous orthonormal columns
-        for (unsigned int k = 0; k < j; k++) {
-            Cx proj = 0.0;
-            for (unsigned int i = 0; i < n; i++)
-                proj += std::conj(q[i][k]) * col[i];
-            for (unsigned int i = 0; i < n; i++)
-                col[i] -= proj * q[i][k];
+        // R's diagonal entry for this column
+        Cx alpha = -x0_phase * x_norm;
+        phase[k] = -x0_phase;
+
+        double v_norm = 0.0;
+        for (unsigned int i = k; i < N; i++){
+            v[i] = a[i * N + k] - ((i == k) ? alpha : Cx(0.0));
+            v_norm += std::norm(v[i]);
         }
+        v_norm = std::sqrt(v_norm);
+
+        if (v_norm == 0.0) continue;
+
+        for (unsigned int i = k; i < N; i++) v[i] /= v_norm;
 
-        // normalise
-        double norm = 0;
-        for (unsigned int i = 0; i < n; i++)
-            norm += std::norm(col[i]);     // std::norm = |c|^2
-        norm = std::sqrt(norm);
+        // a = (I - 2vv^H) a, on the rows and columns the reflection touches
+        for (unsigned int j = k; j < N; j++) {
+            Cx dot = 0.0;
+            for (unsigned int i = k; i < N; i++) dot += std::conj(v[i]) * a[i * N + j];
+            for (unsigned int i = k; i < N; i++) a[i * N + j] -= 2.0 * v[i] * dot;
+        }
 
-        for (unsigned int i = 0; i < n; i++)
-            q[i][j] = col[i] / norm;
+        // q = q (I - 2vv^H)
+        for (unsigned int r = 0; r < N; r++) {
+            Cx dot = 0.0;
+            for (unsigned int i = k; i < N; i++) dot += q[r * N + i] * v[i];
+            for (unsigned int i = k; i < N; i++) q[r * N + i] -= 2.0 * dot * std::conj(v[i]);
+        }
     }
 
-    return q;
+    for (unsigned int r = 0; r < N; r++)
+        for (unsigned int c = 0; c < N; c++)
+            out[r * N + c] = q[r * N + c] * phase[c];
 }
 
 Circuit::Circuit() :
@@ -61,27 +81,104 @@ Circuit::Circuit(std::string _name, unsigned int _n_matrix_qubits) :
     Cloneable<Circuit>("circuit", (_n_matrix_qubits == 2 ? UNITARY_2Q_DEF : UNITARY_1Q_DEF)),
     name(_name),
     n_matrix_qubits(_n_matrix_qubits),
-    dim(1u << _n_matrix_qubits),
-    matrix(std::move(haar_unitary(dim)))
-{}
+    dim(1u << _n_matrix_qubits)
+{
+    std::array<Cx, MAX_MATRIX_DIM * MAX_MATRIX_DIM> matrix;
+
+    if (dim == 2){
+        haar_unitary<2>(matrix.data());
+    } else if (dim == 4){
+        haar_unitary<4>(matrix.data());
+    } else {
+        ERROR("Unitaries can only act on 1 or 2 qubits");
+    }
 
-std::string Circuit::get_val_at(int row, int col) const {
-    std::string out = "";
+    // entries are formatted once here, as "re, im" with enough digits to round trip, rather than at every GET_MAT_POS
+    char buf[64];
+
+    for (unsigned int i = 0; i < dim * dim; i++){
+        matrix_entry_offsets[i] = matrix_entries.size();
+
+        char* end = std::to_chars(buf, buf + sizeof(buf), matrix[i].real(), std::chars_format::general, 17).ptr;
+        matrix_entries.append(buf, end);
+        matrix_entries += ", ";
+
+        end = std::to_chars(buf, buf + sizeof(buf), matrix[i].imag(), std::chars_format::general, 17).ptr;
+        matrix_entries.append(buf, end);
+    }
+
+    matrix_entry_offsets[dim * dim] = matrix_entries.size();
+}
+
+void Circuit::relink(Clone_map& copies){
+    for (auto& kind_resources : resources){
+        for (auto& resource : kind_resources){
+            resource = relinked(resource, copies);
+        }
+    }
+
+    for (auto& pool : pools){
+        for (auto& resource : pool.order){
+            resource = relinked(resource, copies);
+        }
+    }
+
+    for (auto& kind_defs : resource_defs_by_kind){
+        for (auto& def : kind_defs){
+            def = relinked(def, copies);
+        }
+    }
+
+    for (auto& def : resource_defs){
+        def = relinked(def, copies);
+    }
+}
+
+/// The draw scans the unused prefix of the pool on purpose. Every weight depends on `total_times_used`, which changes on every call, so an
+/// alias table would be rebuilt each time, and a Fenwick tree over usage counts costs more than the scan at the sizes seen in practice:
+/// across the bundled grammars the unused prefix holds about 5 resources on average and at most 12, since registers are small and
+/// every gate frees them all again
+std::shared_ptr<Resource> Circuit::use_random_resource(Resource_kind rk, unsigned int total_times_used){
+    Resource_pool& pool = pools[(size_t)rk];
 
+    if (pool.n_unused == 0) {
+        WARNING("[GET_RANDOM_FROM_COLL]: No elements satisfying predicate! Returning dummy");
+        return make_node<Resource>();
+    }
+
+    float rand_f = uniform_float(1.0, 0.0);
+    float prob = 0.0;
+    size_t pick = 0;
+
+    for (size_t i = 0; i < pool.n_unused; i++){
+        float weight = (float)(total_times_used - pool.order[i]->n_times_used()) / (float)total_times_used;
+        prob += weight;
+
+        if (rand_f < prob){
+            pick = i;
+            break;
+        }
+    }
+
+    pool.n_unused--;
+    std::swap(pool.order[pick], pool.order[pool.n_unused]);
+
+    std::shared_ptr<Resource> resource = pool.order[pool.n_unused];
+    resource->set_used();
+
+    return resource;
+}
+
+std::string Circuit::get_val_at(int row, int col) const {
     auto u_row = (unsigned int)std::max(row, 0);
     auto u_col = (unsigned int)std::max(col, 0);
 
     if ((u_row < dim) && (u_col < dim)){
-        double re = matrix[u_row][u_col].real();
-        double im = matrix[u_row][u_col].imag();       
-        
-        // lossless string conversion, to_string truncates decimals to 6dp
-        std::ostringstream stream;
-        stream << std::setprecision(17) << re << ", " << im;
-        out = stream.str();
+        unsigned int i = u_row * dim + u_col;
+        return matrix_entries.substr(matrix_entry_offsets[i], matrix_entry_offsets[i + 1] - matrix_entry_offsets[i]);
     }
 
-    return out;
+    return "";
 }
 
 void Circuit::print_info() const {
@@ -105,8 +202,10 @@ void Circuit::print_info() const {
 
         std::cout << "Resources " << std::endl;
 
-        for(const auto& r : resources){
-            r->print_info();
+        for(const auto& kind_resources : resources){
+            for(const auto& r : kind_resources){
+                r->print_info();
+            }
         }
     }
 
@@ -57,3 +57,11 @@ Token_kind Gate::get_gate_source() const {
 Ptr_coll<Resource_def> Gate::get_resource_defs() const {
     return resource_defs;
 }
+
+void Gate::relink(Clone_map& copies){
+    for (auto& def : resource_defs){
+        def = relinked(def, copies);
+    }
+
+    last_qubit_def = relinked(last_qubit_def, copies);
+}
@@ -11,6 +11,10 @@ bool Qubit_op::is_subroutine_op() const {
     }
 }
 
+void Qubit_op::relink(Clone_map& copies){
+    gate_node = relinked(gate_node, copies);
+}
+
 void Qubit_op::add_gate_if_subroutine(std::vector<std::shared_ptr<Node>>& subroutine_gates){
     assert(gate_node != nullptr);
 
@@ -31,17 +35,20 @@ std::string Qubit_op::resolved_name() const {
 /// Need to check for duplication although I use `Node_gen` because it only differentiates nodes
 /// by their address, not the content. If I spawed `QUBIT` nodes twice after cloning in the AST below this qubit op, 
 /// then I get duplicates. I do this in `ast.cpp` to pass `QUBIT` nodes to specific `REGISTER / SINGULAR` qubits
-std::vector<std::string> Qubit_op::get_target_qubit_names() {
-    std::vector<std::string> qubit_resolved_names;
-    std::set<std::string> seen_names;
+/// Copies of a qubit share its resource id, so ids identify qubits the same way their resolved names do
+const std::vector<unsigned int>& Qubit_op::get_target_qubit_ids() {
+    if (target_qubits_cached) return target_qubit_ids;
+
+    target_qubit_ids.clear();
 
     for (const auto& qubit : resources_from_anscestor(*this, QUBIT)) {        
-        std::string resolved_name = qubit->resolved_name();
+        unsigned int resource_id = qubit->get_resource_id();
 
-        if (seen_names.insert(resolved_name).second){
-            qubit_resolved_names.push_back(resolved_name);
+        if (std::find(target_qubit_ids.begin(), target_qubit_ids.end(), resource_id) == target_qubit_ids.end()){
+            target_qubit_ids.push_back(resource_id);
         }
     }
- 
-    return qubit_resolved_names;
+
+    target_qubits_cached = true;
+    return target_qubit_ids;
 }
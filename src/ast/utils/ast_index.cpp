@@ -0,0 +1,127 @@
+#include <ast_index.h>
+
+Ast_index::Ast_index(Node& root){
+    for (auto& child : root.get_children()){
+        index_subtree(&child, nullptr, top_level);
+    }
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wswitch-enum"
+bool Ast_index::is_indexed_kind(Token_kind kind){
+    switch(kind){
+        case CIRCUIT: case SUB_CIRCUIT: case BODY: case COMPOUND_STMTS: case QUBIT_OP:
+            return true;
+        default:
+            return false;
+    }
+}
+#pragma GCC diagnostic pop
+
+/// Walks with an explicit stack in pre-order, so that indexed nodes are appended to their parents' lists in the order they appear
+void Ast_index::index_subtree(Slot_type slot, const Node* parent, std::vector<const Node*>& out){
+    struct Index_frame {
+        Slot_type slot;
+        const Node* parent;
+        std::vector<const Node*>* out;
+    };
+
+    // entries are never moved by the map, so pointers to their children lists stay valid as more are added
+    std::vector<Index_frame> stack = {{slot, parent, &out}};
+
+    while (!stack.empty()){
+        Index_frame frame = stack.back();
+        stack.pop_back();
+
+        Node* node = frame.slot->get();
+        const Node* children_parent = frame.parent;
+        std::vector<const Node*>* children_out = frame.out;
+
+        if (is_indexed_kind(node->get_node_kind())){
+            Entry& entry = entries[node];
+            entry = Entry{frame.slot, frame.parent, {}};
+            frame.out->push_back(node);
+
+            children_parent = node;
+            children_out = &entry.children;
+        }
+
+        auto& children = node->get_children();
+
+        for (auto it = children.rbegin(); it != children.rend(); ++it){
+            stack.push_back({&*it, children_parent, children_out});
+        }
+    }
+}
+
+void Ast_index::erase_subtree(const Node* node){
+    std::vector<const Node*> stack = {node};
+
+    while (!stack.empty()){
+        auto it = entries.find(stack.back());
+        stack.pop_back();
+
+        if (it != entries.end()){
+            stack.insert(stack.end(), it->second.children.begin(), it->second.children.end());
+            entries.erase(it);
+        }
+    }
+}
+
+std::vector<const Node*>& Ast_index::children_of(const Node* node){
+    return (node == nullptr) ? top_level : entries.at(node).children;
+}
+
+void Ast_index::collect(const std::vector<const Node*>& nodes, Token_kind kind, std::vector<std::shared_ptr<Node>>& out) const {
+    std::vector<const Node*> stack(nodes.rbegin(), nodes.rend());
+
+    while (!stack.empty()){
+        const Node* node = stack.back();
+        stack.pop_back();
+
+        const Entry& entry = entries.at(node);
+
+        if (node->get_node_kind() == kind){
+            out.push_back(*entry.slot);
+        }
+
+        stack.insert(stack.end(), entry.children.rbegin(), entry.children.rend());
+    }
+}
+
+std::vector<std::shared_ptr<Node>> Ast_index::collect(Token_kind kind, const Node* under) const {
+    std::vector<std::shared_ptr<Node>> out;
+
+    if (under == nullptr){
+        collect(top_level, kind, out);
+    } else if (auto it = entries.find(under); it != entries.end()){
+        collect(it->second.children, kind, out);
+    }
+
+    return out;
+}
+
+Slot_type Ast_index::slot_of(const Node* node) const {
+    auto it = entries.find(node);
+    return (it == entries.end()) ? nullptr : it->second.slot;
+}
+
+void Ast_index::update(Slot_type slot, const Node* old_node){
+    auto it = entries.find(old_node);
+
+    if (it == entries.end()){
+        ERROR("Updated node is not part of the AST index");
+    }
+
+    const Node* parent = it->second.parent;
+    erase_subtree(old_node);
+
+    // splice the indexed nodes of the new subtree in where the old node was
+    std::vector<const Node*> replacements;
+    index_subtree(slot, parent, replacements);
+
+    std::vector<const Node*>& siblings = children_of(parent);
+    auto pos = std::find(siblings.begin(), siblings.end(), old_node);
+    pos = siblings.erase(pos);
+    siblings.insert(pos, replacements.begin(), replacements.end());
+}
@@ -4,6 +4,8 @@
 #include <ast.h>
 #include <gate.h>
 #include <qubit_op.h>
+#include <ast_index.h>
+#include <temp_rule_pool.h>
 
 const std::vector<Token_kind> SELF_INVERSE_PAIRS = {
     H, X, Y, Z, CX, CY, CZ, SWAP, CCX, CSWAP, TOFFOLI
@@ -24,13 +26,29 @@ const std::vector<Token_kind> CLIFFORDS = {
     H, X, Y, Z, S, SDG, CX, CY, CZ, SWAP, CCX
 };
 
+/// Walks parent links up from target, checking each parent still holds the node, so this is O(depth) rather than a search of the tree.
+/// Returns nullptr if target is no longer attached below search_root
 Slot_type find_slot_for(const std::shared_ptr<Node>& search_root, const std::shared_ptr<Node>& target) {
-    for (auto& child : search_root->get_children()) {
-        if (child.get() == target.get()) return &child;
-        auto found = find_slot_for(child, target);
-        if (found) return found;
+    Slot_type target_slot = nullptr;
+    std::shared_ptr<Node> node = target;
+
+    while (node != search_root) {
+        std::shared_ptr<Node> parent = node->get_parent();
+        if (parent == nullptr) return nullptr;
+
+        Slot_type slot = parent->slot_of_child(node.get());
+        if (slot == nullptr) return nullptr;
+
+        if (target_slot == nullptr) target_slot = slot;
+        node = parent;
     }
-    return nullptr;
+
+    return target_slot;
+}
+
+void replace_node(Slot_type slot, std::shared_ptr<Node> node) {
+    node->take_parent_of(**slot);
+    *slot = node;
 }
 
 std::shared_ptr<Node> build_ast_from_rule(
@@ -50,9 +68,11 @@ Slot_type build_ast_children(
     unsigned int n_children,
     std::unordered_map<Token_kind, Branch_constraint> descendant_node_branch_constraints
 ){
+    Temp_rule_pool::Build_scope temp_rules;
     std::shared_ptr<Ast> ast_builder = std::make_shared<Ast>(context, nested_depth);
     const Term& term = make_term_from_rule(rule);
     auto child_expr = std::make_shared<IntExpr>(n_children);
+    child_expr->compile();
     return ast_builder->term_branch_to_child_nodes(root, term, descendant_node_branch_constraints, child_expr);
 }
 
@@ -99,23 +119,38 @@ void move_qubits(const std::shared_ptr<Node> source_qubit_anscestor, Slot_type d
         auto dest_it = dest_qubits.begin();
 
         while((source_it != source_qubits.end()) && (dest_it != dest_qubits.end())){
-            *dest_it = (*source_it)->clone(DEEP);
+            replace_node(&*dest_it, (*source_it)->clone(DEEP));
 
-            dest_it++;
-            source_it++;
+            ++dest_it;
+            ++source_it;
+        }
+
+        // qubit ops below dest cached their old qubits
+        if ((*dest_qubit_anscestor)->get_node_kind() == QUBIT_OP){
+            static_pointer_cast<Qubit_op>(*dest_qubit_anscestor)->invalidate_target_qubits();
+        }
+
+        for (const auto& qubit_op : Node_gen(**dest_qubit_anscestor, QUBIT_OP)){
+            static_pointer_cast<Qubit_op>(qubit_op)->invalidate_target_qubits();
         }
     }
 }
 
-unsigned int max_control_flow_depth_rec(const std::shared_ptr<Node> node, unsigned int current_depth) {
-    Token_kind kind = node->get_node_kind();
+unsigned int max_control_flow_depth(const std::shared_ptr<Node> node, unsigned int current_depth) {
+    // each node with the control flow depth of its parent
+    std::vector<std::pair<Node*, unsigned int>> stack = {{node.get(), current_depth}};
+    unsigned int max_depth = current_depth;
+
+    while(!stack.empty()){
+        auto [top, parent_depth] = stack.back();
+        stack.pop_back();
 
-    unsigned int depth = current_depth + (kind == CF_STMT);
-    unsigned int max_depth = depth;
+        unsigned int depth = parent_depth + (top->get_node_kind() == CF_STMT);
+        max_depth = std::max(max_depth, depth);
 
-    for(const std::shared_ptr<Node>& child : node->get_children()){
-        unsigned int child_depth = max_control_flow_depth_rec(child, depth);
-        max_depth = std::max(max_depth, child_depth);
+        for(const std::shared_ptr<Node>& child : top->get_children()){
+            stack.push_back({child.get(), depth});
+        }
     }
 
     return max_depth;
@@ -137,26 +172,30 @@ std::vector<std::shared_ptr<Resource>> resources_from_anscestor(Node& anscestor,
 
 std::pair<bool, std::shared_ptr<Qubit_op>> qubit_op_is_interesting(
     std::shared_ptr<Qubit_op> qubit_op, 
-    std::function<bool(Token_kind, Token_kind)> func, 
-    std::unordered_map<std::string, std::shared_ptr<Qubit_op>>& last_qubit_op_map
+    const std::function<bool(Token_kind, Token_kind)>& func, 
+    std::vector<std::shared_ptr<Qubit_op>>& last_qubit_op_map
 ){
     std::shared_ptr<Gate> gate = qubit_op->get_gate_node();
     Token_kind gate_kind = gate->get_node_kind();
-    auto qubit_names = qubit_op->get_target_qubit_names();
+    const auto& qubit_ids = qubit_op->get_target_qubit_ids();
 
     bool qubits_satisfied = true;
     std::shared_ptr<Qubit_op> prev_qubit_op = nullptr;
 
-    for (const std::string& name : qubit_names){
-        auto it = last_qubit_op_map.find(name);
+    for (unsigned int id : qubit_ids){
+        if (id >= last_qubit_op_map.size()){
+            last_qubit_op_map.resize(id + 1);
+        }
+
+        const std::shared_ptr<Qubit_op>& last_qubit_op = last_qubit_op_map[id];
 
-        if (it == last_qubit_op_map.end()){
+        if (last_qubit_op == nullptr){
             qubits_satisfied = false; break;
         }
 
         if (prev_qubit_op == nullptr){
-            prev_qubit_op = it->second;
-        } else if (it->second != prev_qubit_op){
+            prev_qubit_op = last_qubit_op;
+        } else if (last_qubit_op != prev_qubit_op){
             // for multi qubit gates, need to make sure that last qubit op of all qubits is the same in memory
             qubits_satisfied = false; break;
         }
@@ -166,11 +205,14 @@ std::pair<bool, std::shared_ptr<Qubit_op>> qubit_op_is_interesting(
 
     if (is_intersting){
         // remove all qubits from last_qubit_op tracker
-        for (const auto& name : qubit_names) last_qubit_op_map.erase(name);
+        for (unsigned int id : qubit_ids) last_qubit_op_map[id] = nullptr;
     
     } else {
         // set last qubit op for all qubits
-        for (const auto& name : qubit_names) last_qubit_op_map[name] = qubit_op;
+        for (unsigned int id : qubit_ids){
+            if (id >= last_qubit_op_map.size()) last_qubit_op_map.resize(id + 1);
+            last_qubit_op_map[id] = qubit_op;
+        }
     }
 
     return std::make_pair(is_intersting, prev_qubit_op);
@@ -206,17 +248,16 @@ bool is_commutative_pair(Token_kind a, Token_kind b){
     return false;
 }
 
-std::shared_ptr<Node> get_compilation_unit(std::shared_ptr<Node> root){
+std::shared_ptr<Node> get_compilation_unit(const Ast_index& index){
     std::shared_ptr<Node> comp_unit = nullptr;
-    
-    for(const auto& slot : Node_gen(*root, CIRCUIT)){
-        comp_unit = slot;
-    }
 
-    if (comp_unit == nullptr){
-        for(const auto& slot : Node_gen(*root, BODY)){
-            comp_unit = slot;
-        }
+    auto circuits = index.collect(CIRCUIT);
+
+    if (circuits.size()){
+        comp_unit = circuits.back();
+    } else {
+        auto bodies = index.collect(BODY);
+        if (bodies.size()) comp_unit = bodies.back();
     }
 
     if (comp_unit == nullptr){
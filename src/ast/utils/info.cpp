@@ -13,11 +13,13 @@ Info::Info(const Ast_entry& entry) :
 	}
     #endif
 
+    count_ops();
+
     feature_vecs = {
         Feature("entanglement_density",   entanglement_density(),  10),
         Feature("non_clifford_density",   non_clifford_density(),  10),
-        // Feature("inverse_pair_count", interesting_pair_count(is_inverse_pair), 20),
-        // Feature("commuatative_pair_density", interesting_pair_count(is_commutative_pair), 20),
+        // Feature("inverse_pair_count", n_inverse_pairs, 20),
+        // Feature("commuatative_pair_density", n_commutative_pairs, 20),
     };
 
     for (auto& f : feature_vecs){
@@ -59,87 +61,74 @@ unsigned int Info::get_archive_index() {
     return index;
 }
 
-unsigned int Info::interesting_pair_count(std::function<bool(Token_kind, Token_kind)> func){
-    int n_sequences = 0;
+void Info::count_ops(){
+    // a pair needs at least 2 ops
+    bool count_pairs = qubit_ops.size() >= 2;
 
-    if (qubit_ops.size() < 2) return 0;
+    // qubit id -> last qubit op acting on that qubit, one tracker per pair kind
+    std::vector<std::shared_ptr<Qubit_op>> last_inverse_op_map, last_commutative_op_map;
+    // interacting qubit pairs, packed as (low id, high id)
+    std::vector<uint64_t> seen_pairs;
 
-    // qubit name -> last qubit op acting on that qubit
-    std::unordered_map<std::string, std::shared_ptr<Qubit_op>> last_qubit_op_map;
+    for (const auto& op : qubit_ops){
+        if (op->is_subroutine_op()) continue;
 
-    for (const auto& qubit_op : qubit_ops){
-        if (qubit_op->is_subroutine_op()) continue;
-    
-        n_sequences += qubit_op_is_interesting(qubit_op, func, last_qubit_op_map).first;
+        std::shared_ptr<Gate> gate = op->get_gate_node();
+
+        n_multi_qubit_gates += gate->get_num_external_resources(Resource_kind::QUBIT) > 1;
+        n_non_clifford_gates += !gate_in_set(CLIFFORDS, gate->get_node_kind());
+
+        const auto& qubits = op->get_target_qubit_ids();
+
+        if (qubits.size() >= 2){
+            n_interacting_ops++;
+            // sorted to treat AB == BA
+            auto sorted = qubits;
+            std::sort(sorted.begin(), sorted.end());
+            for (size_t i = 0; i < sorted.size(); i++)
+                for (size_t j = i+1; j < sorted.size(); j++)
+                    seen_pairs.push_back(((uint64_t)sorted[i] << 32) | sorted[j]);
+        }
+
+        if (count_pairs){
+            n_inverse_pairs += qubit_op_is_interesting(op, is_inverse_pair, last_inverse_op_map).first;
+            n_commutative_pairs += qubit_op_is_interesting(op, is_commutative_pair, last_commutative_op_map).first;
+        }
     }
 
-    return n_sequences;
+    std::sort(seen_pairs.begin(), seen_pairs.end());
+    n_distinct_interactions = std::unique(seen_pairs.begin(), seen_pairs.end()) - seen_pairs.begin();
 }
 
 float Info::non_clifford_density(){
-    float non_clifford = 0.0f;
     unsigned int n_qubit_ops = qubit_ops.size();
-    if (n_qubit_ops > 0) {
-        unsigned int nc = 0;
-        for (const auto& op : qubit_ops) {
-            if (!op->is_subroutine_op() &&
-                !gate_in_set(CLIFFORDS, op->get_gate_node()->get_node_kind()))
-                nc++;
-        }
-        non_clifford = (float)nc / (float)n_qubit_ops;
-    }
-
-    return non_clifford;
+    return (n_qubit_ops > 0) ? (float)n_non_clifford_gates / (float)n_qubit_ops : 0.0f;
 }
 
 float Info::entanglement_density(){
-    float entanglement = 0.0f;
     unsigned int n_qubit_ops = qubit_ops.size();
-
-    if (n_qubit_ops > 0) {
-        unsigned int multi_qubit = 0;
-        for (const auto& op : qubit_ops) {
-            if (!op->is_subroutine_op() &&
-                op->get_gate_node()->get_num_external_resources(Resource_kind::QUBIT) > 1)
-                multi_qubit++;
-        }
-        entanglement = (float)multi_qubit / (float)n_qubit_ops;
-    }
-
-    return entanglement;
+    return (n_qubit_ops > 0) ? (float)n_multi_qubit_gates / (float)n_qubit_ops : 0.0f;
 }
 
 float Info::interaction_graph_diversity(){
-    std::unordered_set<std::string> seen_pairs;
-    unsigned int multi_qubit_count = 0;
-
-    for (const auto& op : qubit_ops) {
-        if (op->is_subroutine_op()) continue;
-        auto qubits = op->get_target_qubit_names();
-        if (qubits.size() < 2) continue;
-        multi_qubit_count++;
-        // sorted to treat AB == BA
-        auto sorted = qubits;
-        std::sort(sorted.begin(), sorted.end());
-        for (size_t i = 0; i < sorted.size(); i++)
-            for (size_t j = i+1; j < sorted.size(); j++)
-                seen_pairs.insert(sorted[i] + ":" + sorted[j]);
-    }
-
-    return (multi_qubit_count == 0) ? 0.0f :
-        (float)seen_pairs.size() / (float)multi_qubit_count;
+    return (n_interacting_ops == 0) ? 0.0f :
+        (float)n_distinct_interactions / (float)n_interacting_ops;
 }
 
 float Info::reducibles_density(){
     unsigned int n_qubit_ops = qubit_ops.size();
 
-    float reducible_density = (float)interesting_pair_count(is_inverse_pair) / (float)n_qubit_ops
-        + (float)interesting_pair_count(is_commutative_pair) / (float)n_qubit_ops;
+    float reducible_density = (float)n_inverse_pairs / (float)n_qubit_ops
+        + (float)n_commutative_pairs / (float)n_qubit_ops;
     return std::min(reducible_density, 1.0f);
 }
 
 float Info::quality(){
     if (qubit_ops.size() == 0) return 0.0;
-    return 0.8f * interaction_graph_diversity() + 0.2f * reducibles_density();
-}
 
+    if (!cached_quality.has_value()){
+        cached_quality = 0.8f * interaction_graph_diversity() + 0.2f * reducibles_density();
+    }
+
+    return cached_quality.value();
+}
@@ -42,6 +42,11 @@ void Arm::apply(Ast_entry& genome, std::shared_ptr<Grammar> grammar){
     factory(genome, grammar, blockwise_ratio)->apply();
 }
 
+void Arm::merge(const Arm& other, unsigned int n_merged){
+    total_mutation_trials += other.total_mutation_trials;
+    n_discovered_cells += other.n_discovered_cells;
+    blockwise_ratio = (blockwise_ratio * n_merged + other.blockwise_ratio) / (float)(n_merged + 1);
+}
 
 void Arbiter::add(const std::string& name, Mutation_factory factory, float init_blockwise_ratio) {
     arms.push_back(Arm(name, std::move(factory), init_blockwise_ratio));
@@ -74,8 +79,19 @@ void Arbiter::record(size_t arm_idx, bool cell_discovered) {
     arms[arm_idx].hill_climb(cell_discovered);
 }
 
+void Arbiter::merge(const Arbiter& other) {
+    assert(arms.size() == other.arms.size());
+
+    for (size_t i = 0; i < arms.size(); i++) {
+        arms[i].merge(other.arms[i], n_merged);
+    }
+
+    total_trials += other.total_trials;
+    n_merged += 1;
+}
+
 void Arbiter::print_stats(std::ostream& out) const {
-    std::cout << std::endl;
+    out << std::endl;
     out << "=== Mutation pass stats ===" << std::endl;
     for (const auto& arm : arms) {
         out << arm.get_name()
@@ -86,5 +102,5 @@ void Arbiter::print_stats(std::ostream& out) const {
             << std::endl;
     }
     out << CYAN("==========================") << std::endl;
-    std::cout << std::endl;
+    out << std::endl;
 }
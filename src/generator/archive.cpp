@@ -1,6 +1,8 @@
 #include <archive.h>
 #include <pass.h>
 #include <chrono>
+#include <thread>
+#include <atomic>
 #include <ast_utils.h>
 
 void Archive::dump(const fs::path& path){
@@ -31,19 +33,15 @@ void Archive::dump(const fs::path& path){
 }
 
 float Archive::archive_fill_ratio(){
+    std::lock_guard<std::mutex> lock(filled_lock);
     return (float)filled_archive_indices.size() / (float)archive.size();
 };
 
 float Archive::archive_av_quality(){
-    float total_quality = 0.0;
+    if (archive.size() == 0) return 0.0;
 
-    if (archive.size() == 0) return total_quality;
-
-    for (const Cell& cell : archive){
-        total_quality += cell.get_quality();
-    }
-
-    return total_quality / (float)archive.size();
+    std::lock_guard<std::mutex> lock(filled_lock);
+    return (float)(total_quality / (double)archive.size());
 };
 
 bool Archive::place(const Ast_entry& genome){
@@ -53,10 +51,24 @@ bool Archive::place(const Ast_entry& genome){
     // info.dump_feature_vecs(std::cout);
     // std::cout << std::endl;
 
-    bool new_placement = archive[archive_index].place(genome, info.quality());
+    float quality = info.quality();
+    float quality_gain;
+    bool new_placement;
+
+    {
+        std::lock_guard<std::mutex> lock(cell_lock(archive_index));
+        Cell& cell = archive[archive_index];
+
+        float prev_quality = cell.get_quality();
+        new_placement = cell.place(genome, quality);
+        quality_gain = cell.get_quality() - prev_quality;
+    }
+
+    if (new_placement || (quality_gain != 0.0f)){
+        std::lock_guard<std::mutex> lock(filled_lock);
+        total_quality += quality_gain;
 
-    if (new_placement){
-        filled_archive_indices.push_back(archive_index);
+        if (new_placement) filled_archive_indices.push_back(archive_index);
     }
 
     return new_placement;
@@ -71,12 +83,12 @@ void Archive::init_archive(){
         place(genome);
     }
 
-    std::cout << std::endl;
+    info_stream() << std::endl;
 
     INFO("Init archive average quality " + std::to_string(archive_av_quality()));
     INFO("Init archive fill ratio  " + std::to_string(archive_fill_ratio()));
     
-    std::cout << std::endl;
+    info_stream() << std::endl;
 
     // dump init archive in JSON
     dump(output_dir / "init_archive.json");
@@ -236,7 +248,17 @@ static void register_passes_to_arbiter(Arbiter& arbiter) {
 
 }
 
-void Archive::fill_archive(std::shared_ptr<Grammar> grammar){
+void Archive::fill_archive(std::shared_ptr<Grammar> grammar, unsigned int n_threads){
+    if (filled_archive_indices.empty()){
+        WARNING("MAP-elites archive is empty, there are no genomes to mutate");
+        return;
+    }
+
+    if (n_threads > 1){
+        fill_archive_parallel(grammar, n_threads);
+        return;
+    }
+
     unsigned int max_evals = 200000;
     unsigned int total_evals = 0;
 
@@ -283,7 +305,7 @@ void Archive::fill_archive(std::shared_ptr<Grammar> grammar){
                 INFO("fill ratio = " + std::to_string(archive_fill_ratio()));
                 INFO("av quality = " + std::to_string(archive_av_quality()));
         
-                std::cout << std::endl;
+                info_stream() << std::endl;
 
             } else {
                 evals_since_discovery += 1;
@@ -294,14 +316,14 @@ void Archive::fill_archive(std::shared_ptr<Grammar> grammar){
         total_evals += 1;
     }
 
-    std::cout << std::endl;
+    info_stream() << std::endl;
                                                                                                                 
     INFO("Final archive average quality " + std::to_string(archive_av_quality()));
     INFO("Final archive fill ratio " + std::to_string(archive_fill_ratio()));
 
     dump(output_dir / "final_archive.json");
 
-    arbiter.print_stats(std::cout);
+    arbiter.print_stats(info_stream());
 }                                                                                                                                                                                                                               
 
 std::vector<Ast_entry> Archive::get_best_genomes(){
@@ -309,12 +331,97 @@ std::vector<Ast_entry> Archive::get_best_genomes(){
 
     for(const Cell& cell : archive){
         if (!cell.empty()){
-            Ast_entry entry = cell.get_genome();
-            // update `Ast_entry` internal state because mutations may have added / removed some qubit ops
-            entry.find_qubit_ops();
-            out.push_back(entry);
+            out.push_back(cell.get_genome());
         }
     }
 
     return out;
 }
+
+/// Island-style fill: each worker has its own arbiter and RNG stream, and mutates clones with a private context. Workers share the
+/// archive and the stopping condition, so the run is not reproducible from the seed
+void Archive::fill_archive_parallel(std::shared_ptr<Grammar> grammar, unsigned int n_threads){
+    const unsigned int max_evals = 200000;
+    const unsigned int patience = 2000;
+
+    std::atomic<unsigned int> total_evals = 0;
+    std::atomic<unsigned int> evals_since_discovery = 0;
+    std::mutex report_lock;
+
+    std::vector<Arbiter> arbiters(n_threads);
+    std::vector<unsigned int> seeds(n_threads);
+
+    for (unsigned int w = 0; w < n_threads; w++){
+        register_passes_to_arbiter(arbiters[w]);
+        seeds[w] = uniform_uint(UINT32_MAX);
+    }
+
+    auto worker = [&](unsigned int w){
+        rng().seed(seeds[w]);
+        Arbiter& arbiter = arbiters[w];
+
+        while((total_evals < max_evals) && (evals_since_discovery < patience)){
+            unsigned int random_index;
+
+            {
+                std::lock_guard<std::mutex> lock(filled_lock);
+                random_index = filled_archive_indices[uniform_uint(filled_archive_indices.size() - 1)];
+            }
+
+            Ast_entry parent;
+
+            {
+                std::lock_guard<std::mutex> lock(cell_lock(random_index));
+                parent = archive[random_index].get_genome();
+            }
+
+            // genomes in the archive are never mutated, so cloning them outside the lock is safe
+            Ast_entry genome = parent.clone();
+
+            size_t pass_idx = arbiter.apply(genome, grammar);
+            bool cell_discovered = place(genome);
+            arbiter.record(pass_idx, cell_discovered);
+
+            if (cell_discovered){
+                evals_since_discovery = 0;
+
+                float fill_ratio = archive_fill_ratio();
+                float av_quality = archive_av_quality();
+
+                std::lock_guard<std::mutex> lock(report_lock);
+                INFO("fill ratio = " + std::to_string(fill_ratio));
+                INFO("av quality = " + std::to_string(av_quality));
+                info_stream() << std::endl;
+
+            } else {
+                evals_since_discovery++;
+            }
+
+            total_evals++;
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (unsigned int w = 0; w < n_threads; w++){
+        workers.emplace_back(worker, w);
+    }
+
+    for (std::thread& t : workers){
+        t.join();
+    }
+
+    for (unsigned int w = 1; w < n_threads; w++){
+        arbiters[0].merge(arbiters[w]);
+    }
+
+    info_stream() << std::endl;
+
+    INFO("Final archive average quality " + std::to_string(archive_av_quality()));
+    INFO("Final archive fill ratio " + std::to_string(archive_fill_ratio()));
+    INFO("Total evaluations " + std::to_string(total_evals.load()) + " over " + std::to_string(n_threads) + " threads");
+
+    dump(output_dir / "final_archive.json");
+
+    arbiters[0].print_stats(info_stream());
+}
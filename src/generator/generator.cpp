@@ -1,60 +1,120 @@
 #include <generator.h>
 #include <node_gen.h>
 #include <archive.h>
+#include <output_writer.h>
+#include <thread>
+#include <atomic>
 
 void Generator::ast_parse(const std::vector<Ast_entry>& entries, const fs::path& output_dir, const Control& control){
+    Output_writer writer(output_dir, control);
 
-    std::ofstream stream;
+    for(size_t i = 0; i < entries.size(); i++){
+        writer.push(i, entries[i]);
+    }
+}
 
-    stream = get_stream(output_dir, "regression_seed.txt");
-    stream << control.GLOBAL_SEED_VAL << std::endl;
-    stream.close();
+/// @brief Builds `n` ASTs, handing each one to `on_built` along with its index as soon as it is built.
+/// The seed of every AST is drawn up front from the global generator, so the ASTs produced for a given global seed are the same
+/// whether they are built serially or spread over `control.n_threads` workers, each of which owns its own generator. With several
+/// workers `on_built` is called concurrently, in no particular order
+void Generator::build_n_asts(unsigned int n, const Control& control, const std::function<void(size_t, Ast_entry&&)>& on_built){
+    auto entry_rule = grammar->get_rule_pointer_if_exists(entry_name, entry_scope);
 
-    for(size_t i = 0; i < entries.size(); i++){
-        auto ast = entries[i].get_ast();
+    if (entry_rule == nullptr){
+        ERROR("Rule " + entry_name + " is not defined for grammar " + grammar->get_name());
+    }
+
+    std::vector<unsigned int> seeds(n);
 
-        fs::path current_circuit_dir = output_dir / ("circuit" + std::to_string(i));
+    for (unsigned int& seed : seeds){
+        seed = uniform_uint(UINT32_MAX);
+    }
+
+    int first_ast_id = Context::reserve_ast_ids(n);
+
+    auto build_entry = [&](size_t i){
+        rng().seed(seeds[i]);
+
+        auto arena = std::make_shared<Arena>();
+        Ast_entry entry;
+
+        {
+            Arena::Scope scope(arena);
 
-        stream = get_stream(current_circuit_dir, "prog" + control.ext);
-        ast->print_program(stream);
-        stream.close();
+            Ast ast_builder(control, first_ast_id + i);
+            std::shared_ptr<Node> ast_root = ast_builder.build(entry_rule);
 
-        if (control.render) {
-            render_ast(*ast, current_circuit_dir);
+            entry = Ast_entry(ast_root, ast_builder.get_context(), arena);
+        }
+
+        on_built(i, std::move(entry));
+    };
+
+    unsigned int n_workers = std::min(control.n_threads, n);
+
+    if ((n_workers <= 1) || control.step){
+        // building reseeds this thread's generator, so keep the global stream intact for whatever comes after generation
+        std::mt19937 global_rng = rng();
+
+        for(size_t i = 0; i < n; i++){
+            build_entry(i);
+        }
+
+        rng() = global_rng;
+
+    } else {
+        std::atomic<size_t> next_index = 0;
+        std::vector<std::thread> workers;
+        workers.reserve(n_workers);
+
+        for(unsigned int w = 0; w < n_workers; w++){
+            workers.emplace_back([&](){
+                for(size_t i = next_index++; i < n; i = next_index++){
+                    build_entry(i);
+                }
+            });
+        }
+
+        for(std::thread& worker : workers){
+            worker.join();
         }
     }
 }
 
-/// @brief Generates ASTs and also keeps track of pointers to compilation units within each AST
+/// @brief Generates ASTs and also keeps track of pointers to compilation units within each AST.
 /// @param n 
 /// @param control 
 /// @return 
 std::vector<Ast_entry> Generator::generate_n_asts(unsigned int n, const Control& control){
-    std::vector<Ast_entry> entries;
-    entries.reserve(n);
+    std::vector<Ast_entry> entries(n);
 
-    auto entry_rule = grammar->get_rule_pointer_if_exists(entry_name, entry_scope);
+    build_n_asts(n, control, [&entries](size_t i, Ast_entry&& entry){
+        entries[i] = std::move(entry);
+    });
 
-    if (entry_rule == nullptr){
-        ERROR("Rule " + entry_name + " is not defined for grammar " + grammar->get_name());
+    if (control.print_circuit_info){
+        for (const Ast_entry& entry : entries){
+            entry.get_context()->print_circuit_info();
+        }
     }
 
-    for(size_t i = 0; i < n; i++){
-        unsigned int seed = uniform_uint(UINT32_MAX);
-        rng().seed(seed);
+    return entries;
+}
+
+void Generator::stream_n_programs(unsigned int n, const Control& control, const fs::path& output_dir){
+    Output_writer writer(output_dir, control);
+    std::mutex print_lock;
 
-        Ast ast_builder(control);
-        std::shared_ptr<Node> ast_root = ast_builder.build(entry_rule);
-        std::shared_ptr<Context> context = ast_builder.get_context();
+    build_n_asts(n, control, [&](size_t i, Ast_entry&& entry){
+        Dead_subs(entry).apply();
 
         if (control.print_circuit_info){
-            context->print_circuit_info();
+            std::lock_guard<std::mutex> lock(print_lock);
+            entry.get_context()->print_circuit_info();
         }
 
-        entries.emplace_back(ast_root, context);
-    }
-
-    return entries;
+        writer.push(i, std::move(entry));
+    });
 }
 
 std::vector<Ast_entry> Generator::map_elites(unsigned int n_genomes, const Control& control, const fs::path& output_dir){
@@ -65,7 +125,7 @@ std::vector<Ast_entry> Generator::map_elites(unsigned int n_genomes, const Contr
     Archive archive(entries, output_dir);
     
     archive.init_archive();
-    archive.fill_archive(grammar);
+    archive.fill_archive(grammar, control.n_threads);
 
     return archive.get_best_genomes();
 }
@@ -0,0 +1,77 @@
+#include <output_writer.h>
+
+Output_writer::Output_writer(const fs::path& _output_dir, const Control& _control, size_t _capacity) :
+    output_dir(_output_dir),
+    control(_control),
+    capacity(std::max(_capacity, size_t(1)))
+{
+    fs::create_directories(output_dir);
+
+    stream.open(output_dir / "regression_seed.txt");
+    stream << control.GLOBAL_SEED_VAL << std::endl;
+    stream.close();
+
+    INFO("Writing programs to " + output_dir.string());
+
+    writer = std::thread(&Output_writer::run, this);
+}
+
+void Output_writer::push(size_t index, Ast_entry entry){
+    std::unique_lock<std::mutex> lock(queue_lock);
+    not_full.wait(lock, [this](){ return queue.size() < capacity; });
+
+    queue.emplace_back(index, std::move(entry));
+    lock.unlock();
+
+    not_empty.notify_one();
+}
+
+void Output_writer::finish(){
+    if (!writer.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_lock);
+        done = true;
+    }
+
+    not_empty.notify_one();
+    writer.join();
+
+    INFO("Wrote " + std::to_string(n_written) + " program(s) to " + output_dir.string());
+}
+
+void Output_writer::run(){
+    while (true){
+        std::unique_lock<std::mutex> lock(queue_lock);
+        not_empty.wait(lock, [this](){ return done || !queue.empty(); });
+
+        if (queue.empty()){
+            return;
+        }
+
+        // the entry, and with it the AST's arena, is released at the end of this iteration
+        auto [index, entry] = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        not_full.notify_one();
+
+        write(index, entry);
+    }
+}
+
+void Output_writer::write(size_t index, const Ast_entry& entry){
+    fs::path current_circuit_dir = output_dir / ("circuit" + std::to_string(index));
+    fs::create_directory(current_circuit_dir);
+
+    stream.open(current_circuit_dir / ("prog" + control.ext));
+    entry.get_ast()->print_program(stream);
+    stream.close();
+
+    if (control.render) {
+        const Node& root = *entry.get_ast();
+        render([&root](std::ostringstream& dot_string){root.extend_dot_string(dot_string);}, current_circuit_dir / "ast.png");
+    }
+
+    n_written++;
+}
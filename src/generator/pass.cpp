@@ -19,16 +19,23 @@ static std::shared_ptr<Rule> rule_from_name(const std::string& rule_name, std::s
 }
 
 void Pass::apply(){
+    // nodes built by the mutation belong to the mutated AST
+    Arena::Scope scope(entry.get_arena());
+
+    std::shared_ptr<Ast_index> index = entry.get_index();
+
     // apply blockwise on collected blocks
     for (auto& block : block_nodes){
         float mut_prob = uniform_float(1.0, 0.0);
 
         if(mut_prob < blockwise_rate){
-            auto slot = find_slot_for(entry.get_root(consider_entire_ast), block);
+            // blocks removed by an earlier mutation of an enclosing block are no longer indexed
+            auto slot = index->slot_of(block.get());
 
             if (slot != nullptr) {
                 assert(block->get_node_kind() == block_kind);
                 apply_blockwise(slot);
+                index->update(slot, block.get());
             }
         }
     }
@@ -58,7 +65,7 @@ void Replace_block::apply_blockwise(Slot_type block) const  {
     std::shared_ptr<Node> new_node = build_ast_from_rule(rule, *entry.get_context(), descendant_node_branch_constraints);
 
     new_node->print_mode = (*block)->print_mode;
-    *block= new_node;
+    replace_node(block, new_node);
 }
 
 void Mutate_on_condition::apply_blockwise(Slot_type block) const {
@@ -100,8 +107,8 @@ void Add_gate_chain::apply_blockwise(Slot_type block) const {
 }
 
 void Remove_gate_chain::apply_blockwise(Slot_type block) const {
-    // qubit name -> last qubit op acting on that qubit
-    std::unordered_map<std::string, std::shared_ptr<Qubit_op>> last_qubit_op_map;
+    // qubit id -> last qubit op acting on that qubit
+    std::vector<std::shared_ptr<Qubit_op>> last_qubit_op_map;
 
     auto qubit_ops_gen = Node_gen(**block, QUBIT_OP);
 
@@ -117,12 +124,12 @@ void Remove_gate_chain::apply_blockwise(Slot_type block) const {
 
             if (prev_qubit_op_slot != nullptr){
                 // remove current qubit op and previous qubit op
-                *qubit_ops_it = std::make_shared<Node>();
-                *prev_qubit_op_slot = std::make_shared<Node>();
+                replace_node(&*qubit_ops_it, make_node<Node>());
+                replace_node(prev_qubit_op_slot, make_node<Node>());
             }
         }
 
-        qubit_ops_it++;
+        ++qubit_ops_it;
     }
 }
 
@@ -183,5 +190,5 @@ void Dead_subs::apply_blockwise(Slot_type block) const {
     }
 
     // this block is unreachable
-    *block = std::make_shared<Node>("");
+    replace_node(block, make_node<Node>(""));
 }
@@ -2,11 +2,177 @@
 #include <expr.h>
 #include <resource.h>
 #include <coll.h>
+#include <snapshot.h>
+#include <temp_rule_pool.h>
+
+static std::optional<Bin_op> parse_bin_op(const std::string& op){
+    static const std::unordered_map<std::string, Bin_op> BIN_OPS = {
+        {"+", Bin_op::ADD}, {"-", Bin_op::SUB}, {"*", Bin_op::MUL}, {"/", Bin_op::DIV},
+        {">=", Bin_op::GE}, {"<=", Bin_op::LE}, {"==", Bin_op::EQ}, {"!=", Bin_op::NE},
+        {">", Bin_op::GT}, {"<", Bin_op::LT}, {"&&", Bin_op::AND}, {"||", Bin_op::OR},
+    };
+
+    auto it = BIN_OPS.find(op);
+
+    if (it == BIN_OPS.end()){
+        return std::nullopt;
+    }
+
+    return it->second;
+}
+
+static Scalar apply_bin_op(Bin_op op, int left, int right){
+    switch(op){
+        case Bin_op::ADD: return left + right;
+        case Bin_op::SUB: return left - right;
+        case Bin_op::MUL: return left * right;
+        case Bin_op::DIV: return left / right;
+        case Bin_op::GE: return left >= right;
+        case Bin_op::LE: return left <= right;
+        case Bin_op::EQ: return left == right;
+        case Bin_op::NE: return left != right;
+        case Bin_op::GT: return left > right;
+        case Bin_op::LT: return left < right;
+        case Bin_op::AND: return left && right;
+        case Bin_op::OR: return left || right;
+    }
+
+    ERROR("Unknown binary op");
+}
+
+static int bin_operand(const Scalar& value){
+    if (std::holds_alternative<int>(value)){
+        return std::get<int>(value);
+    } else if (std::holds_alternative<bool>(value)){
+        return std::get<bool>(value) ? 1 : 0;
+    } else {
+        ERROR("Binop operand expected to be int, token, or bool!");
+    }
+}
+
+static bool if_cond(const Scalar& value){
+    if (std::holds_alternative<bool>(value)){
+        return std::get<bool>(value);
+    } else if (std::holds_alternative<int>(value)){
+        return std::get<int>(value) > 0;
+    } else {
+        ERROR("IfExpr expects cond to return bool or int");
+    }
+}
+
+/// every property of a resource or resource def but its name
+static Scalar scalar_property(Context& context, const std::string& obj_name, Token_kind prop_name){
+
+    if (auto resource = context.get_value_bound_to<Resource>(obj_name)){
+        if (prop_name == FROM_REG) {
+            return resource->from_reg();
+        } else if (prop_name == FROM_SING){
+            return !resource->from_reg();
+        } else if (prop_name == N_TIMES_USED) {
+            return (int)resource->n_times_used();
+        } else if (prop_name == IN_EXT) {
+            return resource->get_scope() == Scope::EXT;
+        } else if (prop_name == IN_INT) {
+            return resource->get_scope() == Scope::INT;
+        } else if (prop_name == INDEX) {
+            return (int)resource->get_index();
+        } else {
+            ERROR("Unknown resource property " + kind_as_str(prop_name));
+        }
+
+    } else if (auto resource_def = context.get_value_bound_to<Resource_def>(obj_name)) {
+        if (prop_name == IS_REG) {
+            return resource_def->is_reg();
+        } else if (prop_name == IS_SING){
+            return !resource_def->is_reg();
+        } else if (prop_name == IN_EXT) {
+            return resource_def->get_scope() == Scope::EXT;
+        } else if (prop_name == IN_INT) {
+            return resource_def->get_scope() == Scope::INT;
+        } else if (prop_name == SIZE) {
+            return (int)resource_def->get_size();
+        } else {
+            ERROR("Unknown resource def property " + kind_as_str(prop_name));
+        }
+
+    } else {
+        ERROR(obj_name + " is not bound to any resource or resource def");
+    }
+}
+
+Scalar Expr_code::run(Context& context) const {
+    std::array<Scalar, MAX_STACK> stack;
+    size_t sp = 0;
+    size_t pc = 0;
+
+    while (pc < instrs.size()){
+        const Expr_instr& instr = instrs[pc++];
+
+        switch(instr.op){
+            case Expr_op::PUSH:
+                stack[sp++] = instr.constant;
+                break;
+
+            case Expr_op::VAR:
+                sp -= instr.arg;
+                stack[sp] = context.resolve_scalar_var(instr.kind, &stack[sp], instr.arg);
+                sp++;
+                break;
+
+            case Expr_op::PROPERTY:
+                stack[sp++] = scalar_property(context, names[instr.arg], instr.kind);
+                break;
+
+            case Expr_op::BIN: {
+                int left = bin_operand(stack[sp - 2]);
+                int right = bin_operand(stack[sp - 1]);
+                sp -= 2;
+                stack[sp++] = apply_bin_op(instr.bin, left, right);
+                break;
+            }
+
+            case Expr_op::JUMP_IF_FALSE:
+                if (!if_cond(stack[--sp])){
+                    pc = instr.arg;
+                }
+                break;
+
+            case Expr_op::JUMP:
+                pc = instr.arg;
+                break;
+
+            case Expr_op::POP:
+                sp--;
+                break;
+        }
+    }
+
+    return stack[0];
+}
+
+void Expr::compile(){
+    if (compiled) return;
+
+    compiled = true;
+
+    auto out = std::make_unique<Expr_code>();
+
+    if (emit(*out) && out->fits()){
+        code = std::move(out);
+    } else {
+        compile_children();
+    }
+}
 
 Expr_type IntExpr::eval(Context&) const {
     return value;
 }
 
+bool IntExpr::emit(Expr_code& out) const {
+    out.push(value);
+    return true;
+}
+
 void IntExpr::print(std::ostream& stream) const {
     stream << value;
 };
@@ -15,6 +181,11 @@ Expr_type FloatExpr::eval(Context&) const {
     return value;
 }
 
+bool FloatExpr::emit(Expr_code& out) const {
+    out.push(value);
+    return true;
+}
+
 void FloatExpr::print(std::ostream& stream) const {
     stream << value;
 };
@@ -23,12 +194,31 @@ Expr_type VarExpr::eval(Context& context) const {
     std::vector<Expr_type> eval_args;
 
     for (const auto& arg : args){
-        eval_args.push_back(arg->eval(context));
+        eval_args.push_back(arg->evaluate(context));
     }
 
     return context.resolve_var(name, eval_args);
 }
 
+bool VarExpr::emit(Expr_code& out) const {
+    if (!Context::is_scalar_var(name)){
+        return false;
+    }
+
+    for (const auto& arg : args){
+        if (!arg->emit(out)) return false;
+    }
+
+    out.var(name, args.size());
+    return true;
+}
+
+void VarExpr::compile_children(){
+    for (const auto& arg : args){
+        arg->compile();
+    }
+}
+
 void VarExpr::print(std::ostream& stream) const {
     stream << name;
 
@@ -63,12 +253,35 @@ Expr_type BlockExpr::eval(Context& context) const {
     Expr_type last_val = false; 
 
     for (const auto& expr : expressions) {
-        last_val = expr->eval(context); 
+        last_val = expr->evaluate(context); 
     }
 
     return last_val; 
 }
 
+bool BlockExpr::emit(Expr_code& out) const {
+    if (expressions.empty()){
+        out.push(0);
+        return true;
+    }
+
+    for (size_t i = 0; i < expressions.size(); i++){
+        if (!expressions[i]->emit(out)) return false;
+
+        if (i + 1 < expressions.size()){
+            out.pop();
+        }
+    }
+
+    return true;
+}
+
+void BlockExpr::compile_children(){
+    for (const auto& expr : expressions){
+        expr->compile();
+    }
+}
+
 void BlockExpr::print(std::ostream& stream) const {
     stream << "{ ";
     for(const auto& expr : expressions){
@@ -80,55 +293,36 @@ void BlockExpr::print(std::ostream& stream) const {
 
 Expr_type PropertyAccessExpr::eval(Context& context) const {
 
-    if (auto resource = context.get_value_bound_to<Resource>(obj_name)){
-        if (prop_name == FROM_REG) {
-            return resource->from_reg();
-        } else if (prop_name == FROM_SING){
-            return !resource->from_reg();
-        } else if (prop_name == N_TIMES_USED) {
-            return (int)resource->n_times_used();
-        } else if (prop_name == IN_EXT) {
-            return resource->get_scope() == Scope::EXT;
-        } else if (prop_name == IN_INT) {
-            return resource->get_scope() == Scope::INT;
-        } else if (prop_name == NAME) {
-            return resource->get_var_name();
-        } else if (prop_name == INDEX) {
-            return (int)resource->get_index();
-        } else {
-            ERROR("Unknown resource property " + kind_as_str(prop_name));
-        }
+    if (prop_name != NAME){
+        return to_expr_type(scalar_property(context, obj_name, prop_name));
+    }
 
+    if (auto resource = context.get_value_bound_to<Resource>(obj_name)){
+        return resource->get_var_name();
     } else if (auto resource_def = context.get_value_bound_to<Resource_def>(obj_name)) {
-        if (prop_name == IS_REG) {
-            return resource_def->is_reg();
-        } else if (prop_name == IS_SING){
-            return !resource_def->is_reg();
-        } else if (prop_name == IN_EXT) {
-            return resource_def->get_scope() == Scope::EXT;
-        } else if (prop_name == IN_INT) {
-            return resource_def->get_scope() == Scope::INT;
-        } else if (prop_name == NAME) {
-            return resource_def->get_var_name();
-        } else if (prop_name == SIZE) {
-            return (int)resource_def->get_size();
-        } else {
-            ERROR("Unknown resource def property " + kind_as_str(prop_name));
-        }
-
+        return resource_def->get_var_name();
     } else {
         ERROR(obj_name + " is not bound to any resource or resource def");
     }
 }
 
+bool PropertyAccessExpr::emit(Expr_code& out) const {
+    if (prop_name == NAME){
+        return false;
+    }
+
+    out.property(obj_name, prop_name);
+    return true;
+}
+
 void PropertyAccessExpr::print(std::ostream& stream) const {
     stream << obj_name << "." << prop_name;
 }
 
 
 Expr_type BinExpr::eval(Context& context) const {
-    Expr_type left_eval = left->eval(context);
-    Expr_type right_eval = right->eval(context);
+    Expr_type left_eval = left->evaluate(context);
+    Expr_type right_eval = right->evaluate(context);
 
     static auto resolve_operand = [](const Expr_type& eval)->int{
         if (std::holds_alternative<std::shared_ptr<Rule>>(eval)){
@@ -145,33 +339,27 @@ Expr_type BinExpr::eval(Context& context) const {
     int left = resolve_operand(left_eval);
     int right = resolve_operand(right_eval);
 
-    if (op == "+") {
-        return left + right;
-    } else if (op == "-"){
-        return left - right;
-    } else if (op == ">="){
-        return left >= right;
-    } else if (op == "<="){
-        return left <= right;
-    } else if (op == "=="){
-        return left == right;
-    } else if (op == "!="){
-        return left != right;
-    } else if (op == "*"){
-        return left * right;
-    } else if (op == "/"){
-        return left / right;
-    } else if (op == ">"){
-        return left > right;
-    } else if (op == "<"){
-        return left < right;
-    } else if (op == "&&"){
-        return left && right;
-    } else if (op == "||"){
-        return left || right;        
+    if (std::optional<Bin_op> bin_op = parse_bin_op(op)){
+        return to_expr_type(apply_bin_op(*bin_op, left, right));
     } else {
         ERROR("Unknown binary op " + op);
-    }        
+    }
+}
+
+bool BinExpr::emit(Expr_code& out) const {
+    std::optional<Bin_op> bin_op = parse_bin_op(op);
+
+    if (!bin_op || !left->emit(out) || !right->emit(out)){
+        return false;
+    }
+
+    out.bin(*bin_op);
+    return true;
+}
+
+void BinExpr::compile_children(){
+    left->compile();
+    right->compile();
 }
 
 void BinExpr::print(std::ostream& stream) const {
@@ -183,7 +371,7 @@ void BinExpr::print(std::ostream& stream) const {
 }
 
 Expr_type IfExpr::eval(Context& context) const {
-    auto cond_eval = cond->eval(context);
+    auto cond_eval = cond->evaluate(context);
 
     bool eval;
 
@@ -196,14 +384,44 @@ Expr_type IfExpr::eval(Context& context) const {
     }
 
     if (eval) {
-        return true_branch->eval(context);
+        return true_branch->evaluate(context);
     } else if (false_branch != nullptr) {
-        return false_branch->eval(context);
+        return false_branch->evaluate(context);
     } else {
         return 0;
     }        
 }
 
+bool IfExpr::emit(Expr_code& out) const {
+    if (!cond->emit(out)) return false;
+
+    size_t to_else = out.jump_if_false();
+
+    if (!true_branch->emit(out)) return false;
+
+    size_t to_end = out.jump();
+    out.patch(to_else);
+    out.start_else();
+
+    if (false_branch == nullptr){
+        out.push(0);
+    } else if (!false_branch->emit(out)){
+        return false;
+    }
+
+    out.patch(to_end);
+    return true;
+}
+
+void IfExpr::compile_children(){
+    cond->compile();
+    true_branch->compile();
+
+    if (false_branch != nullptr){
+        false_branch->compile();
+    }
+}
+
 void IfExpr::print(std::ostream& stream) const {
     if (false_branch == nullptr){
         stream << "if (" << *cond << "): \n" << *true_branch;
@@ -215,11 +433,11 @@ void IfExpr::print(std::ostream& stream) const {
 Expr_type ForExpr::eval(Context& context) const {
     std::vector<std::shared_ptr<Rule>> yielded_rules;
 
-    auto get_rules = [&]<typename T>(Ptr_coll<T> items){
+    auto get_rules = [&]<typename T>(std::span<const std::shared_ptr<T>> items){
         for (const auto& res : items) {
             context.push_var<T>(iter_var, res);
 
-            auto body_eval = body->eval(context);
+            auto body_eval = body->evaluate(context);
 
             if (std::holds_alternative<std::shared_ptr<Rule>>(body_eval)){
                 auto rule = std::get<std::shared_ptr<Rule>>(body_eval);
@@ -253,7 +471,7 @@ Expr_type ForExpr::eval(Context& context) const {
         Resource_kind rk = iterable == ALL_GATE_QUBIT_DEFS ? Resource_kind::QUBIT : Resource_kind::BIT;
         auto pred = [rk](const auto& elem){ return elem->get_resource_kind() == rk; };
         auto items = filter<Resource_def>(resource_defs, pred);
-        get_rules(items);
+        get_rules(std::span<const std::shared_ptr<Resource_def>>(items));
 
     } else {
         ERROR("Unknown iterable " + iterable);
@@ -262,6 +480,10 @@ Expr_type ForExpr::eval(Context& context) const {
     return yielded_rules;
 }
 
+void ForExpr::compile_children(){
+    body->compile();
+}
+
 void ForExpr::print(std::ostream& stream) const {
     stream << "for " << iter_var << " in " << iterable << " \n"
     << *body;
@@ -269,18 +491,15 @@ void ForExpr::print(std::ostream& stream) const {
 
 
 Expr_type AssignExpr::eval(Context& context) const {
-    static int id = 0;
-    std::string temp_name = "__temp_assign_" + std::to_string(id++);
-
-    auto dynamic_rule = std::make_shared<Rule>(Token{temp_name, RULE}, Scope::GLOB);
+    std::shared_ptr<Rule> dynamic_rule = Temp_rule_pool::acquire(rule->get_name());
 
-    if (!rule->is_empty()) {
-        for (const auto& branch : rule->get_branches()){
-            dynamic_rule->add(branch.eval_term_exprs(context));
-        }
+    for (const auto& branch : rule->get_branches()){
+        dynamic_rule->add(branch.eval_term_exprs(context));
     }
 
-    context.push_var<Rule>(rule->get_name(), dynamic_rule);
+    dynamic_rule->build_tables();
+
+    context.rebind_rule(rule->get_name(), dynamic_rule);
 
     return 0;
 }
@@ -290,7 +509,7 @@ void AssignExpr::print(std::ostream& stream) const {
 }
 
 Expr_type ModExpr::eval(Context& context) const {
-    Expr_type expr_eval = expr->eval(context);
+    Expr_type expr_eval = expr->evaluate(context);
     
     if (modifier == INT_CAST){
         if (std::holds_alternative<std::string>(expr_eval)){
@@ -322,6 +541,220 @@ Expr_type ModExpr::eval(Context& context) const {
     }
 }
 
+void ModExpr::compile_children(){
+    expr->compile();
+}
+
 void ModExpr::print(std::ostream& stream) const {
     stream << modifier << "(" << *expr << ")" << std::endl;
 }
+
+void IntExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::INT);
+    out.i32(value);
+}
+
+void FloatExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::FLOAT);
+    out.f32(value);
+}
+
+void VarExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::VAR);
+    out.u32(name);
+    out.u32(args.size());
+
+    for (const auto& arg : args){
+        out.expr(arg.get());
+    }
+}
+
+void RuleExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::RULE);
+    out.str(rule_name);
+    out.rule(rule);
+}
+
+void BlockExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::BLOCK);
+    out.u32(expressions.size());
+
+    for (const auto& expr : expressions){
+        out.expr(expr.get());
+    }
+}
+
+void PropertyAccessExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::PROPERTY_ACCESS);
+    out.str(obj_name);
+    out.u32(prop_name);
+}
+
+void BinExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::BIN);
+    out.str(op);
+    out.expr(left.get());
+    out.expr(right.get());
+}
+
+void IfExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::IF);
+    out.expr(cond.get());
+    out.expr(true_branch.get());
+    out.expr(false_branch.get());
+}
+
+void ForExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::FOR);
+    out.str(iter_var);
+    out.u32(iterable);
+    out.expr(body.get());
+}
+
+void AssignExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::ASSIGN);
+    out.rule(rule);
+}
+
+void ModExpr::serialise(Snapshot_writer& out) const {
+    out.u8((uint8_t)Expr_tag::MOD);
+    out.expr(expr.get());
+    out.u32(modifier);
+}
+
+void Snapshot_writer::expr(const Expr* e){
+    if (e == nullptr){
+        u8((uint8_t)Expr_tag::NONE);
+    } else {
+        e->serialise(*this);
+        u8(e->paren);
+    }
+}
+
+std::unique_ptr<Expr> Snapshot_reader::expr(){
+    auto read_exprs = [this](){
+        std::vector<std::unique_ptr<Expr>> exprs;
+        uint32_t n = count();
+
+        for (uint32_t i = 0; (i < n) && !failed(); i++){
+            exprs.push_back(expr());
+        }
+
+        return exprs;
+    };
+
+    std::unique_ptr<Expr> out = nullptr;
+
+    switch ((Expr_tag)u8()){
+        case Expr_tag::NONE:
+            return nullptr;
+
+        case Expr_tag::INT:
+            out = std::make_unique<IntExpr>(i32());
+            break;
+
+        case Expr_tag::FLOAT:
+            out = std::make_unique<FloatExpr>(f32());
+            break;
+
+        case Expr_tag::VAR: {
+            Token_kind name = (Token_kind)u32();
+            out = std::make_unique<VarExpr>(name, read_exprs());
+            break;
+        }
+
+        case Expr_tag::RULE: {
+            std::string rule_name = str();
+            out = std::make_unique<RuleExpr>(rule_name, rule());
+            break;
+        }
+
+        case Expr_tag::BLOCK:
+            out = std::make_unique<BlockExpr>(read_exprs());
+            break;
+
+        case Expr_tag::PROPERTY_ACCESS: {
+            std::string obj_name = str();
+            out = std::make_unique<PropertyAccessExpr>(obj_name, (Token_kind)u32());
+            break;
+        }
+
+        case Expr_tag::BIN: {
+            std::string op = str();
+            std::unique_ptr<Expr> left = expr();
+            std::unique_ptr<Expr> right = expr();
+
+            if ((left == nullptr) || (right == nullptr)){
+                fail = true;
+                return nullptr;
+            }
+
+            out = std::make_unique<BinExpr>(op, std::move(left), std::move(right));
+            break;
+        }
+
+        case Expr_tag::IF: {
+            std::unique_ptr<Expr> cond = expr();
+            std::unique_ptr<Expr> true_branch = expr();
+            std::unique_ptr<Expr> false_branch = expr();
+
+            if ((cond == nullptr) || (true_branch == nullptr)){
+                fail = true;
+                return nullptr;
+            }
+
+            out = std::make_unique<IfExpr>(std::move(cond), std::move(true_branch), std::move(false_branch));
+            break;
+        }
+
+        case Expr_tag::FOR: {
+            std::string iter_var = str();
+            Token_kind iterable = (Token_kind)u32();
+            std::unique_ptr<Expr> body = expr();
+
+            if (body == nullptr){
+                fail = true;
+                return nullptr;
+            }
+
+            out = std::make_unique<ForExpr>(iter_var, iterable, std::move(body));
+            break;
+        }
+
+        case Expr_tag::ASSIGN: {
+            std::shared_ptr<Rule> rule_ptr = rule();
+
+            if (rule_ptr == nullptr){
+                fail = true;
+                return nullptr;
+            }
+
+            out = std::make_unique<AssignExpr>(rule_ptr);
+            break;
+        }
+
+        case Expr_tag::MOD: {
+            std::unique_ptr<Expr> _expr = expr();
+
+            if (_expr == nullptr){
+                fail = true;
+                return nullptr;
+            }
+
+            out = std::make_unique<ModExpr>(std::move(_expr), (Token_kind)u32());
+            break;
+        }
+
+        default:
+            fail = true;
+            return nullptr;
+    }
+
+    out->paren = u8();
+
+    if (failed()){
+        return nullptr;
+    }
+
+    return out;
+}
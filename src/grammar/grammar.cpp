@@ -3,14 +3,15 @@
 #include <params.h>
 #include <supported_gates.h>
 
-Grammar::Grammar(const fs::path& filename, std::vector<Token>& meta_grammar_tokens) : 
+Grammar::Grammar(const fs::path& filename, std::shared_ptr<const std::vector<Token>> meta_grammar_tokens) : 
+    meta_tokens(std::move(meta_grammar_tokens)),
     lexer(filename.string()), 
     name(filename.stem()), 
     path(filename)
 {
-    tokens = append_vectors(meta_grammar_tokens, lexer.get_tokens());
+    tokens = lexer.get_tokens();
 
-    num_tokens = tokens.size();
+    num_tokens = meta_tokens->size() + tokens.size();
 
     consume(0); // prepare current token
 }
@@ -51,7 +52,7 @@ void Grammar::consume(int n){
         grammar_error("Out of tokens! Consumed too much");
     } else {
         prev_token = curr_token;
-        curr_token = tokens[token_pointer];
+        curr_token = token_at(token_pointer);
         peek();
     }
 }
@@ -63,7 +64,7 @@ void Grammar::consume(const std::string& expected, std::source_location loc){
 
 void Grammar::peek(){
     if((token_pointer + 1) < num_tokens){
-        next_token = tokens[token_pointer+1];
+        next_token = token_at(token_pointer+1);
     } else if (curr_token.kind != _EOF){
         grammar_error("Cannot peek!");
     }
@@ -73,8 +74,8 @@ void Grammar::back(){
     if(token_pointer == 0){
         grammar_error("Cannot back!");
     } else {
-        curr_token = tokens[--token_pointer];
-        if (token_pointer > 0) prev_token = tokens[token_pointer - 1];
+        curr_token = token_at(--token_pointer);
+        if (token_pointer > 0) prev_token = token_at(token_pointer - 1);
         peek();
     }
 }
@@ -95,7 +96,7 @@ std::string Grammar::dig_to_syntax(const std::string& rule_name) const {
 
     if(rule_ptr == nullptr) return "";
 
-    auto branches = rule_ptr->get_branches();
+    const auto& branches = rule_ptr->get_branches();
 
     if (branches.size() == 1){
         auto terms = branches[0].get_terms();
@@ -188,7 +189,12 @@ void Grammar::add_branch_to_current_rule(){
         if (!stack_top.branch.is_empty()){
             stack_top.rule->add(current_branch);
             stack_top.branch.clear();
+
+        } else if (stack_top.branch_weighted){
+            grammar_error("Branch weight given to an empty branch of " + stack_top.rule->get_name());
         }
+
+        stack_top.branch_weighted = false;
     } else {
         grammar_error("Rule at stack top is null");
     }
@@ -466,6 +472,23 @@ Token_kind Grammar::parse_token(){
     } else if (curr_token.kind == SEPARATOR){
         add_branch_to_current_rule();
 
+    } else if (curr_token.kind == BRANCH_WEIGHT){
+        consume();
+
+        float weight = ((curr_token.kind == INTEGER) || (curr_token.kind == FLOAT)) ? std::stof(curr_token.value) : 0.0f;
+
+        if (!(weight > 0.0f) || !std::isfinite(weight)){
+            grammar_error("Branch weight must be a positive number, got " + curr_token.value);
+        }
+
+        // a group is a branch term like any other, so its weight is that of the branch it sits in, and must not clash with another
+        if (current().branch_weighted){
+            grammar_error("Branch of " + current().rule->get_name() + " given more than one weight");
+        }
+
+        current().branch.set_weight(weight);
+        current().branch_weighted = true;
+
     } else if (curr_token.kind == OPTIONAL){
         std::vector<std::unique_ptr<Expr>> args;
         args.reserve(2);
@@ -553,6 +576,25 @@ void Grammar::print_tokens() const {
     lexer.print_tokens();
 }
 
+void Grammar::compute_branch_costs(){
+    // costs only ever go down, so this settles
+    bool changed = true;
+
+    while(changed){
+        changed = false;
+
+        for(const auto& rule : rule_pointers){
+            changed |= rule->update_costs();
+        }
+    }
+}
+
+void Grammar::build_branch_tables(){
+    for(const auto& rule : rule_pointers){
+        rule->build_tables();
+    }
+}
+
 void Grammar::print_rules() const {
     for(const auto& p : rule_pointers){
         std::cout << p->get_name() << " ";
@@ -1,12 +1,75 @@
 #include <rule.h>
 #include <node.h>
 
+static unsigned int branch_cost(const Branch& branch){
+    uint64_t cost = 0;
+
+    for(const Term& term : branch){
+        std::shared_ptr<Rule> rule = term.is_rule() ? term.get_rule() : nullptr;
+        cost += 1 + ((rule == nullptr) ? 0 : rule->get_min_cost());
+    }
+
+    return (unsigned int)std::min(cost, (uint64_t)Rule::UNBOUNDED_COST);
+}
+
 void Rule::add(const Branch& branch){
+    size_t index = branches.size();
     branches.push_back(branch);
 
+    branch_costs.push_back(branch_cost(branch));
+    min_cost = std::min(min_cost, branch_costs.back());
+
     if(branch.get_recursive_flag()){
         recursive = true; // this rule is recursive
     }
+
+    // a kind seen for the first time occurs 0 times in every earlier branch
+    for(const Term& term : branch){
+        if(term.is_rule() && !branches_by_occurances.contains(term.get_node_kind())){
+            branches_by_occurances[term.get_node_kind()][0] = all_branches;
+        }
+    }
+
+    for(auto& [kind, by_count] : branches_by_occurances){
+        by_count[branch.count_rule_occurances(kind)].add(index, branch.get_weight());
+    }
+
+    all_branches.add(index, branch.get_weight());
+}
+
+void Rule::build_tables(){
+    all_branches.build_table();
+
+    for(auto& [kind, by_count] : branches_by_occurances){
+        for(auto& [n_occurances, branch_set] : by_count){
+            branch_set.build_table();
+        }
+    }
+}
+
+const Branch_set& Rule::admissible_branches(Token_kind kind, unsigned int n_occurances) const {
+    static const Branch_set none;
+
+    auto it = branches_by_occurances.find(kind);
+
+    if(it == branches_by_occurances.end()){
+        return (n_occurances == 0) ? all_branches : none;
+    }
+
+    auto jt = it->second.find(n_occurances);
+
+    return (jt == it->second.end()) ? none : jt->second;
+}
+
+bool Rule::update_costs(){
+    unsigned int prev_min_cost = min_cost;
+
+    for(size_t i = 0; i < branches.size(); i++){
+        branch_costs[i] = branch_cost(branches[i]);
+        min_cost = std::min(min_cost, branch_costs[i]);
+    }
+
+    return min_cost != prev_min_cost;
 }
 
 bool Rule::contains_rule(const Token_kind& other_rule){
@@ -22,28 +85,16 @@ bool Rule::contains_rule(const Token_kind& other_rule){
 /// the correct branch to make the child nodes
 /// @param parent
 /// @return
-Branch Rule::pick_branch(std::shared_ptr<Node> rule_as_node){
-    size_t size = branches.size();
+const Branch& Rule::pick_branch(std::shared_ptr<Node> rule_as_node, bool cheapest) const {
+    static const Branch empty;
 
-    bool valid_branch_exists = false;
+    const std::optional<Branch_constraint>& constraint = rule_as_node->get_branch_constraint();
 
-    for (const auto& branch : branches) {
-        if (rule_as_node->branch_satisfies_constraints(branch)) {
-            valid_branch_exists = true;
-            break;
-        }
-    }
+    const Branch_set& admissible = constraint.has_value() ?
+        admissible_branches(constraint->get_kind(), constraint->get_n_occurances()) :
+        all_branches;
 
-    if(valid_branch_exists){
-        Branch branch = branches[uniform_uint(size - 1)];
-
-        while(!rule_as_node->branch_satisfies_constraints(branch)){
-            branch = branches[uniform_uint(size - 1)];
-        }
-
-        return branch;
-
-    } else {
+    if(admissible.empty()){
 
         #ifdef DEBUG
         if(rule_as_node->has_branch_constraint()){
@@ -53,6 +104,21 @@ Branch Rule::pick_branch(std::shared_ptr<Node> rule_as_node){
         }
         #endif
 
-        return Branch();
+        return empty;
+    }
+
+    size_t index = admissible.indices[0];
+
+    if(cheapest){
+        for(size_t i : admissible.indices){
+            if(branch_costs[i] < branch_costs[index]) index = i;
+        }
+    } else {
+        index = admissible.draw();
     }
+
+    const Branch& branch = branches[index];
+    assert(rule_as_node->branch_satisfies_constraints(branch));
+
+    return branch;
 }
@@ -0,0 +1,220 @@
+#include <grammar.h>
+#include <snapshot.h>
+#include <params.h>
+#include <random>
+
+static constexpr uint32_t SNAPSHOT_MAGIC = 0x53474651; // "QFGS"
+
+// bump whenever the snapshot layout, or the way grammars are parsed, changes
+static constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+/// 64 bit FNV-1a
+static void fnv1a(uint64_t& hash, const void* data, size_t n){
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    for (size_t i = 0; i < n; i++){
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+static bool read_file(const fs::path& path, std::string& out){
+    std::ifstream stream(path, std::ios::binary);
+
+    if (!stream) return false;
+
+    stream.seekg(0, std::ios::end);
+    out.resize(stream.tellg());
+    stream.seekg(0, std::ios::beg);
+    stream.read(out.data(), out.size());
+
+    return bool(stream);
+}
+
+uint64_t Grammar::snapshot_key(const fs::path& meta_grammar_path, const fs::path& grammar_path){
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    auto add_u64 = [&hash](uint64_t v){ fnv1a(hash, &v, sizeof(v)); };
+
+    add_u64(SNAPSHOT_VERSION);
+    add_u64(QuteFuzz::WILDCARD_MAX);
+
+    for (const Token_matcher& tm : TOKEN_RULES){
+        add_u64(tm.pattern.size());
+        fnv1a(hash, tm.pattern.data(), tm.pattern.size());
+        add_u64(tm.kind);
+    }
+
+    std::string contents;
+
+    for (const fs::path& path : {meta_grammar_path, grammar_path}){
+        if (!read_file(path, contents)){
+            contents.clear();
+        }
+
+        add_u64(contents.size());
+        fnv1a(hash, contents.data(), contents.size());
+    }
+
+    return hash;
+}
+
+void Grammar::save_snapshot(const fs::path& file, uint64_t key) const {
+    Snapshot_writer out(rule_pointers);
+
+    out.u32(SNAPSHOT_MAGIC);
+    out.u32(SNAPSHOT_VERSION);
+    out.u64(key);
+    out.str(name);
+
+    std::vector<Token> grammar_tokens = lexer.get_tokens();
+    out.u32(grammar_tokens.size());
+
+    for (const Token& token : grammar_tokens){
+        out.str(token.value);
+        out.u32(token.kind);
+    }
+
+    // rules are all declared before any branch is written, since branches may refer to rules defined later
+    out.u32(rule_pointers.size());
+
+    for (const auto& rule : rule_pointers){
+        out.str(rule->get_token().value);
+        out.u32(rule->get_token().kind);
+        out.u32((uint32_t)rule->get_scope());
+    }
+
+    for (const auto& rule : rule_pointers){
+        const std::vector<Branch>& branches = rule->get_branches();
+        out.u32(branches.size());
+
+        for (const Branch& branch : branches){
+            out.u8(branch.get_recursive_flag());
+            out.f32(branch.get_weight());
+            out.u32(branch.size());
+
+            for (const Term& term : branch){
+                out.u8(term.is_rule());
+
+                if (term.is_rule()){
+                    out.rule(term.get_rule());
+                } else {
+                    out.str(term.get_syntax());
+                }
+
+                out.u32(term.get_node_kind());
+                out.u8((uint8_t)term.get_print_mode());
+                out.expr(term.get_expr().get());
+            }
+        }
+    }
+
+    // write under a temporary name first so that concurrent runs never see a partially written snapshot
+    fs::path tmp = file;
+    tmp += ".tmp" + std::to_string(std::random_device{}());
+
+    std::error_code error;
+    fs::create_directories(file.parent_path(), error);
+
+    std::ofstream stream(tmp, std::ios::binary);
+    stream.write(out.get_data().data(), out.get_data().size());
+    stream.close();
+
+    if (!stream){
+        fs::remove(tmp, error);
+        WARNING("Could not write grammar snapshot " + file.string());
+        return;
+    }
+
+    fs::rename(tmp, file, error);
+
+    if (error){
+        fs::remove(tmp, error);
+        WARNING("Could not write grammar snapshot " + file.string());
+    }
+}
+
+std::optional<Grammar> Grammar::load_snapshot(const fs::path& file, uint64_t key, const fs::path& grammar_path){
+    std::string data;
+
+    if (!read_file(file, data)){
+        return std::nullopt;
+    }
+
+    Snapshot_reader in(data);
+
+    if ((in.u32() != SNAPSHOT_MAGIC) || (in.u32() != SNAPSHOT_VERSION) || (in.u64() != key)){
+        return std::nullopt;
+    }
+
+    Grammar grammar;
+    grammar.name = in.str();
+    grammar.path = grammar_path;
+
+    std::vector<Token> grammar_tokens(in.count(sizeof(uint32_t) * 2));
+
+    for (Token& token : grammar_tokens){
+        token.value = in.str();
+        token.kind = (Token_kind)in.u32();
+    }
+
+    grammar.lexer = Lexer(std::move(grammar_tokens));
+
+    grammar.rule_pointers.resize(in.count(sizeof(uint32_t) * 3));
+
+    for (auto& rule : grammar.rule_pointers){
+        Token token;
+        token.value = in.str();
+        token.kind = (Token_kind)in.u32();
+        Scope scope = (Scope)in.u32();
+
+        rule = std::make_shared<Rule>(token, scope);
+    }
+
+    in.set_rules(grammar.rule_pointers);
+
+    for (auto& rule : grammar.rule_pointers){
+        uint32_t n_branches = in.count();
+
+        for (uint32_t b = 0; (b < n_branches) && !in.failed(); b++){
+            Branch branch;
+
+            if (in.u8()){
+                branch.set_recursive_flag();
+            }
+
+            branch.set_weight(in.f32());
+
+            uint32_t n_terms = in.count();
+
+            for (uint32_t t = 0; (t < n_terms) && !in.failed(); t++){
+                bool is_rule = in.u8();
+
+                std::shared_ptr<Rule> term_rule = nullptr;
+                std::string syntax;
+
+                if (is_rule){
+                    term_rule = in.rule();
+                } else {
+                    syntax = in.str();
+                }
+
+                Token_kind kind = (Token_kind)in.u32();
+                Print_mode print_mode = (Print_mode)in.u8();
+
+                Term term = is_rule ? Term(term_rule, kind, print_mode) : Term(syntax, kind);
+                term.add_expr(in.expr());
+
+                branch.add(term);
+            }
+
+            rule->add(branch);
+        }
+    }
+
+    if (in.failed() || !in.at_end()){
+        return std::nullopt;
+    }
+
+    return grammar;
+}
@@ -94,26 +94,22 @@ std::vector<Term> Term::eval_expr(Context& context) const {
 	if (expr == nullptr){
 		child_terms = std::vector<Term>(1, *this);
 	
+	} else if (const Expr_code* code = expr->get_code()){
+		Term term = *this;
+		term.add_expr(nullptr); // such that term's expr is not evaluated again
+		child_terms = std::vector<Term>(repeat_count(code->run(context)), term);
+
 	} else {
 		Expr_type expr_eval = expr->eval(context);
 
-		if (std::holds_alternative<int>(expr_eval)){
+		if (std::holds_alternative<int>(expr_eval) || std::holds_alternative<bool>(expr_eval)){
             Term term = *this;
-            int size = std::get<int>(expr_eval);
-            term.add_expr(nullptr); // such that term's expr is not evaluated again
+            term.add_expr(nullptr);
 
-            if (size >= 0){
-			    child_terms = std::vector<Term>(size, term);
+            if (std::holds_alternative<int>(expr_eval)){
+                child_terms = std::vector<Term>(repeat_count(std::get<int>(expr_eval)), term);
             } else {
-                std::cout << *this << std::endl;
-                ERROR("IntExpr must evaluate to +ve value!");
-            }
-
-        } else if (std::holds_alternative<bool>(expr_eval)){
-            if (std::get<bool>(expr_eval)){
-			    Term term = *this;
-                term.add_expr(nullptr);
-                child_terms.push_back(term);
+                child_terms = std::vector<Term>(repeat_count(std::get<bool>(expr_eval)), term);
             }
 
 		} else if (std::holds_alternative<std::string>(expr_eval)){
@@ -127,7 +123,6 @@ std::vector<Term> Term::eval_expr(Context& context) const {
 			auto rules = std::get<Rule_list>(expr_eval);
 
 			for (std::shared_ptr<Rule> rule : rules){
-                // std::cout << *rule << std::endl;
 				child_terms.push_back(make_term_from_rule(rule));
 			}
 		
@@ -139,6 +134,25 @@ std::vector<Term> Term::eval_expr(Context& context) const {
 	return child_terms;
 }
 
+unsigned int Term::repeat_count(const Scalar& value) const {
+    if (std::holds_alternative<bool>(value)){
+        return std::get<bool>(value) ? 1 : 0;
+
+    } else if (std::holds_alternative<int>(value)){
+        int size = std::get<int>(value);
+
+        if (size < 0){
+            std::cout << *this << std::endl;
+            ERROR("IntExpr must evaluate to +ve value!");
+        }
+
+        return size;
+
+    } else {
+        ERROR("Expr is expected to have a return type of INT, STR, RULE or RULE_LIST");
+    }
+}
+
 Term make_term_from_rule(std::shared_ptr<Rule> rule_ptr){
 	Token_kind kind = rule_ptr->get_token().kind;
 	return Term(rule_ptr, kind, Print_mode::DEFAULT);
@@ -3,7 +3,14 @@
 #include <vector>
 #include <run.h>
 
-int main(){
+int main(int argc, char** argv){
+
+    if (argc > 1){
+        Batch_options options = Run::parse_batch_options(argc, argv);
+
+        Run run(options.grammars_dir.string());
+        return run.batch(options);
+    }
 
     Run run("../templates");
     run.loop();
@@ -9,7 +9,16 @@
     INFO(name + " " + FLAG_STATUS(f)); \
 }
 
+/// directory holding the running `qf` binary, or the working directory if that cannot be found
+static fs::path executable_dir(){
+    std::error_code error;
+    fs::path exe = fs::read_symlink("/proc/self/exe", error);
+
+    return error ? fs::current_path() : exe.parent_path();
+}
+
 const fs::path Run::OUTPUT_DIR = ".." / fs::path(QuteFuzz::OUTPUTS_FOLDER_NAME);
+const fs::path Run::GRAMMAR_CACHE_DIR = executable_dir() / ".qf_cache";
 
 const std::unordered_map<std::string, std::string> COMMANDS = {
     {"grammar-name entry-point", "Generate program from template given by grammar-name starting from entry-point"},
@@ -19,6 +28,7 @@ const std::unordered_map<std::string, std::string> COMMANDS = {
     {"info", "Print circuit info"},
     {"map-elites", "Toggle map elites algorithm"},
     {"seed", "Set global seed"},
+    {"threads", "Set number of worker threads used to generate programs and fill the MAP-elites archive"},
     {"print-grammar", "Print grammar data structure for set grammar"},
     {"print-tokens", "Print tokens parsed from set grammar"},
     {"quit \\ Ctrl-D", "Quit"},
@@ -58,53 +68,98 @@ static void print_banner() {
     std::cout << "Type 'h' for help.\n";
 }
 
-Run::Run(const std::string& _grammars_dir) : grammars_dir(_grammars_dir) {
-    print_banner();
+static Control default_control(){
+    return Control{
+        .GLOBAL_SEED_VAL = 0,
+        .render = false,
+        .step = false,
+        .print_circuit_info = false,
+        .map_elites = false,
+        .n_threads = 1,
+        .ext = ".text",
+        .expected_values = {
+            Expected<unsigned int>("MAX_REG_SIZE", QuteFuzz::MAX_REG_SIZE, CLAMP_DOWN),
+            Expected<unsigned int>("NESTED_MAX_DEPTH", QuteFuzz::NESTED_MAX_DEPTH, CLAMP_DOWN),
+            Expected<unsigned int>("MAX_AST_DEPTH", QuteFuzz::MAX_AST_DEPTH, NO_CLAMP),
+            Expected<unsigned int>("MAX_AST_NODES", QuteFuzz::MAX_AST_NODES, NO_CLAMP),
+            Expected<unsigned int>("MAX_AST_BYTES", QuteFuzz::MAX_AST_BYTES, NO_CLAMP),
+            Expected<unsigned int>("MAX_AST_MILLIS", QuteFuzz::MAX_AST_MILLIS, NO_CLAMP)
+        },
+        // TODO: make this better
+        .expected_rules = {
+            Expected<std::shared_ptr<Rule>>("register_qubit_def", Scope::EXT, nullptr),
+            Expected<std::shared_ptr<Rule>>("register_qubit_def", Scope::GLOB, nullptr),
+            Expected<std::shared_ptr<Rule>>("register_qubit_def", Scope::INT, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_qubit_def", Scope::EXT, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_qubit_def", Scope::GLOB, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_qubit_def", Scope::INT, nullptr),
+            Expected<std::shared_ptr<Rule>>("register_bit_def", Scope::EXT, nullptr),
+            Expected<std::shared_ptr<Rule>>("register_bit_def", Scope::GLOB, nullptr),
+            Expected<std::shared_ptr<Rule>>("register_bit_def", Scope::INT, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_bit_def", Scope::EXT, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_bit_def", Scope::GLOB, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_bit_def", Scope::INT, nullptr),
+            Expected<std::shared_ptr<Rule>>("register_param_def", Scope::EXT, nullptr),
+            Expected<std::shared_ptr<Rule>>("register_param_def", Scope::GLOB, nullptr),
+            Expected<std::shared_ptr<Rule>>("register_param_def", Scope::INT, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_param_def", Scope::EXT, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_param_def", Scope::GLOB, nullptr),
+            Expected<std::shared_ptr<Rule>>("singular_param_def", Scope::INT, nullptr),
+            Expected<std::shared_ptr<Rule>>("gate_op", Scope::GLOB, nullptr),
+        },
+        // filled in by `Control::resolve` once a grammar is selected
+        .resolved = {},
+    };
+}
 
-    std::vector<Token> meta_grammar_tokens;
+static unsigned int parse_uint_arg(const std::string& flag, const std::string& value){
+    try {
+        size_t pos = 0;
+        unsigned long ret = std::stoul(value, &pos);
 
-    fs::create_directory(OUTPUT_DIR);
+        if ((pos == value.size()) && (ret <= UINT32_MAX)){
+            return ret;
+        }
 
-    // build all grammars
-    try{
+    } catch (const std::exception&) {}
 
-        if(fs::exists(grammars_dir) && fs::is_directory(grammars_dir)){
-            /*
-                find meta grammar
-            */
-            for(auto& file : fs::directory_iterator(grammars_dir)){
+    ERROR("Expected an unsigned integer after " + flag + ", got \"" + value + "\"");
+}
 
-                if(file.is_regular_file() && (file.path().stem() == QuteFuzz::META_GRAMMAR_NAME)){
-                    Lexer lexer(file.path().string());
-                    meta_grammar_tokens = std::move(lexer.get_tokens());
+static void batch_usage(const char* prog){
+    std::cout << "Usage: " << prog << " --grammar NAME [options]" << std::endl
+        << "       " << prog << "                    (no arguments starts the interactive REPL)" << std::endl << std::endl
+        << "  --grammar NAME       Grammar to generate programs from, e.g. pytket" << std::endl
+        << "  --entry RULE         Entry point rule (default: program)" << std::endl
+        << "  --count N            Number of programs to generate (default: 1)" << std::endl
+        << "  --seed N             Global seed (default: random)" << std::endl
+        << "  --output-dir DIR     Directory programs are written to (default: ../outputs/NAME)" << std::endl
+        << "  --map-elites         Select programs with the MAP-elites algorithm" << std::endl
+        << "  --threads N          Number of worker threads (default: 1)" << std::endl
+        << "  --templates DIR      Directory holding the grammars (default: ../templates)" << std::endl
+        << "  --verbose            Also print progress, not only warnings and errors" << std::endl
+        << "  --quiet              Only print warnings and errors (default)" << std::endl
+        << "  --help               Print this message" << std::endl;
+}
 
-                    // remove EOF from meta grammar's tokens
-                    meta_grammar_tokens.pop_back();
-                    break;
-                }
-            }
+Run::Run(const std::string& _grammars_dir) : grammars_dir(_grammars_dir) {
 
-            /*
-                parse all other grammars, appending the tokens grammar to each one
-            */
-            std::cout << std::endl;
+    // find meta grammar and all other grammars, which are only built when needed
+    try{
+
+        if(fs::exists(grammars_dir) && fs::is_directory(grammars_dir)){
 
             for(auto& file : fs::directory_iterator(grammars_dir)){
 
-                if(file.is_regular_file() && (file.path().extension() == ".qf") && (file.path().stem() != QuteFuzz::META_GRAMMAR_NAME)){
+                if(!file.is_regular_file() || (file.path().extension() != ".qf")) continue;
 
-                    Grammar grammar(file, meta_grammar_tokens);
-                    grammar.build_grammar();
-                
-                    std::string name = grammar.get_name();
-                    std::cout << GREEN(BOLD("Built ")) << CYAN(name) << std::endl;
+                if(file.path().stem() == QuteFuzz::META_GRAMMAR_NAME){
+                    meta_grammar_path = file.path();
 
-                    generators[name] = std::make_shared<Generator>(grammar);
+                } else {
+                    grammar_files[file.path().stem().string()] = file.path();
                 }
             }
-
-            std::cout << std::endl;
-
         }
 
     } catch (const fs::filesystem_error& error) {
@@ -113,19 +168,60 @@ Run::Run(const std::string& _grammars_dir) : grammars_dir(_grammars_dir) {
 
 }
 
-void Run::set_grammar(Control& control){
+bool Run::build_grammar(const std::string& name){
+    auto it = grammar_files.find(name);
+
+    if(it == grammar_files.end()){
+        return false;
+    }
+
+    fs::path snapshot = GRAMMAR_CACHE_DIR / (name + ".qfs");
+    uint64_t key = Grammar::snapshot_key(meta_grammar_path, it->second);
+
+    if(std::optional<Grammar> cached = Grammar::load_snapshot(snapshot, key, it->second)){
+        info_stream() << GREEN(BOLD("Loaded ")) << CYAN(name) << GREY(" (cached)") << std::endl;
+
+        cached->compute_branch_costs();
+        cached->build_branch_tables();
+
+        generators[name] = std::make_shared<Generator>(*cached);
+        return true;
+    }
+
+    if(meta_grammar_tokens == nullptr){
+        std::vector<Token> _tokens = Lexer(meta_grammar_path.string()).get_tokens();
+
+        // remove EOF from meta grammar's tokens
+        _tokens.pop_back();
+
+        meta_grammar_tokens = std::make_shared<const std::vector<Token>>(std::move(_tokens));
+    }
 
-    std::string grammar_name = tokens[0], entry_name;
-    tokenise(tokens[1], ',');
+    // parse grammar, appending the tokens of the meta grammar to it
+    Grammar grammar(it->second, meta_grammar_tokens);
+    grammar.build_grammar();
+    grammar.compute_branch_costs();
+    grammar.build_branch_tables();
+    grammar.save_snapshot(snapshot, key);
 
-    entry_name = tokens[0];
+    info_stream() << GREEN(BOLD("Built ")) << CYAN(name) << std::endl;
+
+    generators[name] = std::make_shared<Generator>(grammar);
+
+    return true;
+}
+
+void Run::set_grammar(const std::string& grammar_name, const std::string& entry_name, Control& control){
 
     Scope entry_scope = Scope::GLOB;
+    std::string entry = entry_name;
 
-    current_generator = generators[grammar_name];
-    current_generator->set_grammar_entry(entry_name, entry_scope);
+    if(!generators.contains(grammar_name) && !build_grammar(grammar_name)){
+        ERROR("Grammar " + grammar_name + " not found in " + grammars_dir.string());
+    }
 
-    setup_output_dir(grammar_name);
+    current_generator = generators[grammar_name];
+    current_generator->set_grammar_entry(entry, entry_scope);
 
     control.ext = current_generator->get_grammar()->dig_to_syntax("EXTENSION");
 
@@ -144,12 +240,18 @@ void Run::set_grammar(Control& control){
     }
 
     for(auto& exp : control.expected_values){
+        unsigned int value = safe_stoul(current_grammar->dig_to_syntax(exp.rule_name), exp.dflt);
+
         if(exp.cd == CLAMP_UP){
-            exp.value = std::max(safe_stoul(current_grammar->dig_to_syntax(exp.rule_name), exp.dflt), exp.dflt);
+            exp.value = std::max(value, exp.dflt);
+        } else if(exp.cd == CLAMP_DOWN){
+            exp.value = std::min(value, exp.dflt);
         } else {
-            exp.value = std::min(safe_stoul(current_grammar->dig_to_syntax(exp.rule_name), exp.dflt), exp.dflt);
+            exp.value = value;
         }
     }
+
+    control.resolve();
 }
 
 void Run::tokenise(const std::string& command, const char& delim){
@@ -164,10 +266,23 @@ void Run::tokenise(const std::string& command, const char& delim){
     }
 }
 
-void Run::remove_all_in_dir(const fs::path& dir){
+/// only what qf itself writes is removed, so that pointing `--output-dir` at a directory holding anything else is harmless
+static bool is_qf_output(const fs::path& path){
+    const std::string name = path.filename().string();
+
+    if(fs::is_directory(path)){
+        return name.starts_with("circuit") && (name.size() > 7) && std::all_of(name.begin() + 7, name.end(), ::isdigit);
+    }
+
+    return (name == "regression_seed.txt") || (name == "init_archive.json") || (name == "final_archive.json");
+}
+
+void Run::remove_outputs_in_dir(const fs::path& dir){
     if(fs::exists(dir) && fs::is_directory(dir)){
         for(const auto& entry : fs::directory_iterator(dir)){
-            fs::remove_all(entry.path());
+            if(is_qf_output(entry.path())){
+                fs::remove_all(entry.path());
+            }
         }
     }
 }
@@ -178,43 +293,47 @@ void Run::help(){
     }
 }
 
+void Run::generate(unsigned int n_programs, Control& control){
+    remove_outputs_in_dir(current_output_dir);
+
+    if (!control.map_elites){
+        current_generator->stream_n_programs(n_programs, control, current_output_dir);
+        return;
+    }
+
+    // MAP-elites needs every genome in hand before it can select the programs to write
+    std::vector<Ast_entry> entries = current_generator->map_elites(n_programs, control, current_output_dir);
+
+    for (Ast_entry& entry : entries){
+        Dead_subs(entry).apply();
+    }
+
+    current_generator->ast_parse(
+        entries,
+        current_output_dir,
+        control
+    );
+}
+
 void Run::loop(){
 
+    print_banner();
+
+    // grammars are only built once they are selected
+    std::set<std::string> grammar_names;
+
+    for(const auto& [name, path] : grammar_files){
+        grammar_names.insert(name);
+    }
+
+    std::cout << "Grammars:";
+    for(const std::string& name : grammar_names){
+        std::cout << " " << CYAN(name);
+    }
+    std::cout << std::endl << std::endl;
+
     std::string current_command;
-    Control qf_control = {
-        .GLOBAL_SEED_VAL = 0,
-        .render = false,
-        .step = false,
-        .print_circuit_info = false,
-        .map_elites = false,
-        .ext = ".text",
-        .expected_values = {
-            Expected<unsigned int>("MAX_REG_SIZE", QuteFuzz::MAX_REG_SIZE, CLAMP_DOWN),
-            Expected<unsigned int>("NESTED_MAX_DEPTH", QuteFuzz::NESTED_MAX_DEPTH, CLAMP_DOWN)
-        },
-        // TODO: make this better
-        .expected_rules = {
-            Expected<std::shared_ptr<Rule>>("register_qubit_def", Scope::EXT, nullptr),
-            Expected<std::shared_ptr<Rule>>("register_qubit_def", Scope::GLOB, nullptr),
-            Expected<std::shared_ptr<Rule>>("register_qubit_def", Scope::INT, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_qubit_def", Scope::EXT, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_qubit_def", Scope::GLOB, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_qubit_def", Scope::INT, nullptr),
-            Expected<std::shared_ptr<Rule>>("register_bit_def", Scope::EXT, nullptr),
-            Expected<std::shared_ptr<Rule>>("register_bit_def", Scope::GLOB, nullptr),
-            Expected<std::shared_ptr<Rule>>("register_bit_def", Scope::INT, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_bit_def", Scope::EXT, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_bit_def", Scope::GLOB, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_bit_def", Scope::INT, nullptr),
-            Expected<std::shared_ptr<Rule>>("register_param_def", Scope::EXT, nullptr),
-            Expected<std::shared_ptr<Rule>>("register_param_def", Scope::GLOB, nullptr),
-            Expected<std::shared_ptr<Rule>>("register_param_def", Scope::INT, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_param_def", Scope::EXT, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_param_def", Scope::GLOB, nullptr),
-            Expected<std::shared_ptr<Rule>>("singular_param_def", Scope::INT, nullptr),
-            Expected<std::shared_ptr<Rule>>("gate_op", Scope::GLOB, nullptr),
-        },
-    };
+    Control qf_control = default_control();
 
     init_global_seed(qf_control);
 
@@ -245,10 +364,17 @@ void Run::loop(){
 
         } else if(tokens.size() == 2){
             if (is_grammar(tokens[0])){
-                set_grammar(qf_control);
+                std::string grammar_name = tokens[0];
+                tokenise(tokens[1], ',');
+
+                set_grammar(grammar_name, tokens[0], qf_control);
+                setup_output_dir(OUTPUT_DIR / grammar_name);
             } else if (tokens[0] == "seed") {
                 init_global_seed(qf_control, safe_stoul(tokens[1], 0));
                 INFO("Global seed set to " + std::to_string(qf_control.GLOBAL_SEED_VAL));
+            } else if (tokens[0] == "threads") {
+                qf_control.n_threads = std::max(safe_stoul(tokens[1], 1), 1u);
+                INFO("Generating with " + std::to_string(qf_control.n_threads) + " thread(s)");
             }
 
         } else if(current_command == "h"){
@@ -274,21 +400,7 @@ void Run::loop(){
                 current_generator->print_grammar();
 
             } else if ((n_programs = safe_stoul(current_command, 1))){
-                remove_all_in_dir(current_output_dir);
-
-                std::vector<Ast_entry> entries = qf_control.map_elites ?
-                    current_generator->map_elites(n_programs, qf_control, current_output_dir) :
-                    current_generator->generate_n_asts(n_programs, qf_control);
-                
-                for (Ast_entry& entry : entries){
-                    Dead_subs(entry).apply();
-                }                
-
-                current_generator->ast_parse(
-                    entries,
-                    current_output_dir,
-                    qf_control
-                );
+                generate(n_programs, qf_control);
 
                 init_global_seed(qf_control);  // reset global seed due to seed changes by each AST
             }
@@ -299,3 +411,100 @@ void Run::loop(){
         }
     }
 }
+
+Batch_options Run::parse_batch_options(int argc, char** argv){
+    Batch_options options;
+
+    for (int i = 1; i < argc; i++){
+        std::string flag = argv[i];
+
+        // flags that take a value
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc){
+                ERROR("Missing value after " + flag);
+            }
+            return argv[++i];
+        };
+
+        if (flag == "--help" || flag == "-h"){
+            batch_usage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+
+        } else if (flag == "--grammar"){
+            options.grammar_name = value();
+
+        } else if (flag == "--entry"){
+            options.entry_name = value();
+
+        } else if (flag == "--count"){
+            options.n_programs = parse_uint_arg(flag, value());
+
+        } else if (flag == "--seed"){
+            options.seed = parse_uint_arg(flag, value());
+
+        } else if (flag == "--output-dir"){
+            options.output_dir = value();
+
+        } else if (flag == "--map-elites"){
+            options.map_elites = true;
+
+        } else if (flag == "--threads"){
+            options.n_threads = std::max(parse_uint_arg(flag, value()), 1u);
+
+        } else if (flag == "--templates"){
+            options.grammars_dir = value();
+
+        } else if (flag == "--verbose"){
+            options.quiet = false;
+
+        } else if (flag == "--quiet"){
+            options.quiet = true;
+
+        } else {
+            batch_usage(argv[0]);
+            ERROR("Unknown argument " + flag);
+        }
+    }
+
+    if (options.grammar_name.empty()){
+        batch_usage(argv[0]);
+        ERROR("--grammar is required");
+    }
+
+    if (options.n_programs == 0){
+        ERROR("--count must be at least 1");
+    }
+
+    return options;
+}
+
+int Run::batch(const Batch_options& options){
+    set_quiet(options.quiet);
+
+    if (meta_grammar_path.empty()){
+        ERROR("Meta grammar " + std::string(QuteFuzz::META_GRAMMAR_NAME) + ".qf not found in " + grammars_dir.string());
+    }
+
+    if (!is_grammar(options.grammar_name)){
+        ERROR("Grammar " + options.grammar_name + " not found in " + grammars_dir.string());
+    }
+
+    Control control = default_control();
+    control.map_elites = options.map_elites;
+    control.n_threads = options.n_threads;
+
+    set_grammar(options.grammar_name, options.entry_name, control);
+
+    if (generators[options.grammar_name]->get_grammar()->get_rule_pointer_if_exists(options.entry_name, Scope::GLOB) == nullptr){
+        ERROR("Grammar " + options.grammar_name + " does not define entry point " + options.entry_name);
+    }
+
+    setup_output_dir(options.output_dir.value_or(OUTPUT_DIR / options.grammar_name));
+
+    init_global_seed(control, options.seed);
+    INFO("Global seed set to " + std::to_string(control.GLOBAL_SEED_VAL));
+
+    generate(options.n_programs, control);
+
+    return EXIT_SUCCESS;
+}
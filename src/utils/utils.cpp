@@ -2,6 +2,19 @@
 #include <sstream>
 #include <params.h>
 
+static bool quiet = false;
+
+void set_quiet(bool _quiet){
+    quiet = _quiet;
+}
+
+std::ostream& info_stream(){
+    // a stream without a buffer swallows whatever is written to it
+    static std::ostream discard(nullptr);
+
+    return quiet ? discard : std::cout;
+}
+
 [[noreturn]]
 void ERROR(const std::string& msg, std::source_location location){
     std::cerr << "[ERROR] " << RED(msg) 
@@ -11,12 +24,14 @@ void ERROR(const std::string& msg, std::source_location location){
 }
 
 void WARNING(const std::string& msg, std::source_location location){
-    std::cout << "[WARNING] " << YELLOW(msg) 
+    (quiet ? std::cerr : std::cout) << "[WARNING] " << YELLOW(msg) 
               << " (" << location.file_name() << ":" << location.line() << ")" 
               << std::endl;
 }
 
 void INFO(const std::string& msg){
+    if (quiet) return;
+
     std::cout << "[INFO] " << GREEN(msg) << std::endl;
 }
 
@@ -36,8 +51,9 @@ void lower(std::string& str){
     );
 }
 
+/// Each thread owns its own generator, such that generation workers can be seeded independently
 std::mt19937& rng(){
-    static std::mt19937 random_gen;
+    thread_local std::mt19937 random_gen;
     return random_gen;
 }
 
@@ -0,0 +1,26 @@
+#include "test_utils.h"
+
+/*
+    An AST as deep as a grammar's MAX_AST_DEPTH allows must build, print and be released without running out of stack. The chain below
+    keeps recursing until the node budget runs out, at a depth of about 125k
+*/
+
+int main(){
+    fs::path templates = qf_test::write_grammar("chain",
+        "EXTENSION = \".py\";\n"
+        "MAX_AST_DEPTH = 200000;\n"
+        "MAX_AST_NODES = 250000;\n"
+        "program = a circuit;\n"
+        "a = \"x\" a @ 200000 | \"y\";\n"
+    );
+
+    auto programs = qf_test::run_and_read("chain_out", "--grammar chain --templates " + templates.string() + " --seed 1 2> /dev/null", 1);
+
+    std::string program = programs["circuit0/prog.py"];
+    size_t n_x = program.find_first_not_of('x');
+
+    qf_test::check(n_x > 100000, "chain is " + std::to_string(n_x) + " levels deep");
+    qf_test::check(program.substr(n_x) == "y", "chain is printed as a run of x ending in y");
+
+    return qf_test::report("test_deep_ast");
+}
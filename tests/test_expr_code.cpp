@@ -0,0 +1,70 @@
+#include "test_utils.h"
+#include <grammar.h>
+#include <context.h>
+#include <lex.h>
+
+/*
+    Compiled expressions must give exactly what walking their tree does, drawing random numbers in the same order. Each expression is
+    run both ways from the same generator state
+*/
+
+static constexpr unsigned int N_DRAWS = 200;
+
+int main(){
+    fs::path templates = qf_test::write_grammar("exprs",
+        "exprs = \"a\"[3 + 4 * 2 - 9 / 2]\n"
+        "    | \"b\"[UNIFORM(1, 9)]\n"
+        "    | \"c\"[UNIFORM(0, 5) + UNIFORM(2, 7) * 2]\n"
+        "    | \"d\"[UNIFORM(0, 3) >= 2 && UNIFORM(0, 3) != 1 || UNIFORM(0, 1) == 0]\n"
+        "    | \"e\"[if UNIFORM(0, 1) == 1 {UNIFORM(4, 8)} else {2}]\n"
+        "    | \"f\"[MAKE_INTEGER - 3]\n"
+        "    | \"g\"[(7 - UNIFORM(0, 9)) * (UNIFORM(1, 4) - 2)]\n"
+        "    | \"h\"[MAKE_FLOAT];\n"
+    );
+
+    std::vector<Token> meta_tokens = Lexer((qf_test::templates_dir / (std::string(QuteFuzz::META_GRAMMAR_NAME) + ".qf")).string()).get_tokens();
+    meta_tokens.pop_back();
+
+    Grammar grammar(templates / "exprs.qf", std::make_shared<const std::vector<Token>>(std::move(meta_tokens)));
+    grammar.build_grammar();
+
+    std::shared_ptr<Rule> rule = grammar.get_rule_pointer_if_exists("exprs", Scope::GLOB);
+    CHECK(rule != nullptr);
+
+    Control control{};
+    Context context(control, 0);
+
+    unsigned int n_exprs = 0;
+
+    for (const Branch& branch : rule->get_branches()){
+        for (const Term& term : branch){
+            std::shared_ptr<Expr> expr = term.get_expr();
+
+            if (expr == nullptr) continue;
+
+            n_exprs++;
+
+            std::ostringstream printed;
+            printed << *expr;
+
+            qf_test::check(expr->get_code() != nullptr, printed.str() + " is compiled");
+
+            for (unsigned int seed = 0; seed < N_DRAWS; seed++){
+                rng().seed(seed);
+                Expr_type walked = expr->eval(context);
+
+                rng().seed(seed);
+                Expr_type run = expr->evaluate(context);
+
+                if (walked != run){
+                    qf_test::check(false, printed.str() + " gives the same value compiled as walked, with seed " + std::to_string(seed));
+                    break;
+                }
+            }
+        }
+    }
+
+    CHECK(n_exprs == 8);
+
+    return qf_test::report("test_expr_code");
+}
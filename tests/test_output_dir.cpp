@@ -0,0 +1,25 @@
+#include "test_utils.h"
+
+/*
+    Generating into a directory clears out what an earlier run wrote there, and nothing else
+*/
+
+int main(){
+    fs::path output_dir = qf_test::scratch_dir("output_dir");
+
+    std::ofstream(output_dir / "notes.txt") << "keep me";
+    fs::create_directories(output_dir / "circuits_by_hand");
+    fs::create_directories(output_dir / "circuit999");
+
+    int status = qf_test::run_qf(
+        "--grammar pytket --templates " + qf_test::templates_dir.string() + " --seed 7 --count 2 --output-dir " + output_dir.string()
+    );
+
+    CHECK(status == 0);
+    CHECK(qf_test::read_file(output_dir / "notes.txt") == "keep me");
+    CHECK(fs::exists(output_dir / "circuits_by_hand"));
+    CHECK(!fs::exists(output_dir / "circuit999"));
+    CHECK(fs::exists(output_dir / "regression_seed.txt"));
+
+    return qf_test::report("test_output_dir");
+}
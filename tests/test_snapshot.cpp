@@ -0,0 +1,35 @@
+#include "test_utils.h"
+
+/*
+    A grammar loaded from its snapshot must generate exactly what the freshly built grammar does. Each grammar is copied under a name of
+    its own, so that this test owns the snapshots it removes
+*/
+
+static const fs::path cache_dir = fs::path(QF_BINARY).parent_path() / ".qf_cache";
+
+int main(){
+    for (const std::string& grammar : qf_test::compared_grammars){
+        const std::string name = "snapshot_" + grammar;
+        fs::path templates = qf_test::write_grammar(name, qf_test::read_file(qf_test::templates_dir / (grammar + ".qf")));
+
+        fs::remove(cache_dir / (name + ".qfs"));
+
+        std::map<std::string, std::map<std::string, std::string>> outputs;
+
+        for (const std::string run : {"fresh", "cached"}){
+            fs::path log = fs::current_path() / (name + "_" + run + ".log");
+
+            outputs[run] = qf_test::run_and_read(name + "_" + run,
+                "--grammar " + name + " --templates " + templates.string() + " --seed 11 --count 8 --verbose > " + log.string(),
+                8
+            );
+
+            std::string expected = (run == "fresh") ? "Built" : "Loaded";
+            qf_test::check(qf_test::read_file(log).find(expected) != std::string::npos, name + " " + run + " run is " + expected);
+        }
+
+        qf_test::check(outputs["fresh"] == outputs["cached"], name + " output from the snapshot matches output from the fresh build");
+    }
+
+    return qf_test::report("test_snapshot");
+}
@@ -0,0 +1,21 @@
+#include "test_utils.h"
+
+/*
+    Programs generated for a given seed must not depend on how many worker threads build them. Each run is a separate process, as
+    AST ids keep counting up for the lifetime of one
+*/
+
+int main(){
+    for (const std::string& grammar : qf_test::compared_grammars){
+        auto generate = [&grammar](unsigned int n_threads){
+            return qf_test::run_and_read(grammar + "_threads_" + std::to_string(n_threads),
+                "--grammar " + grammar + " --templates " + qf_test::templates_dir.string() + " --seed 42 --count 12 --threads " + std::to_string(n_threads),
+                12
+            );
+        };
+
+        qf_test::check(generate(1) == generate(4), grammar + " output with 1 thread matches output with 4 threads");
+    }
+
+    return qf_test::report("test_threads");
+}
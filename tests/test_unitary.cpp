@@ -0,0 +1,65 @@
+#include "test_utils.h"
+#include <circuit.h>
+
+/*
+    Unitaries sampled for custom gates must be unitary as written out, and Haar random. For an n x n Haar unitary the squared magnitude
+    of any entry has mean 1 / n, which any orthonormalisation of Gaussian columns gives, and |tr U|^2 has mean 1, which only holds once
+    the phases of R's diagonal are moved onto Q. Without that step the diagonal is biased and the mean is well above 1
+*/
+
+static constexpr unsigned int N_SAMPLES = 2000;
+
+static Cx parse_entry(const std::string& entry){
+    size_t comma = entry.find(',');
+    return Cx(std::stod(entry.substr(0, comma)), std::stod(entry.substr(comma + 1)));
+}
+
+int main(){
+    rng().seed(3);
+
+    for (unsigned int n_qubits : {1u, 2u}){
+        const int dim = 1 << n_qubits;
+
+        double max_error = 0.0;
+        double mean_norm = 0.0;
+        double mean_trace_norm = 0.0;
+
+        for (unsigned int sample = 0; sample < N_SAMPLES; sample++){
+            Circuit unitary("u", n_qubits);
+
+            std::vector<Cx> u(dim * dim);
+            for (int row = 0; row < dim; row++){
+                for (int col = 0; col < dim; col++){
+                    u[row * dim + col] = parse_entry(unitary.get_val_at(row, col));
+                }
+            }
+
+            // U U^dagger = I
+            for (int row = 0; row < dim; row++){
+                for (int col = 0; col < dim; col++){
+                    Cx dot = 0.0;
+                    for (int k = 0; k < dim; k++) dot += u[row * dim + k] * std::conj(u[col * dim + k]);
+
+                    max_error = std::max(max_error, std::abs(dot - Cx((row == col) ? 1.0 : 0.0)));
+                }
+            }
+
+            mean_norm += std::norm(u[0]) / N_SAMPLES;
+
+            Cx trace = 0.0;
+            for (int i = 0; i < dim; i++) trace += u[i * dim + i];
+
+            mean_trace_norm += std::norm(trace) / N_SAMPLES;
+        }
+
+        const std::string name = std::to_string(n_qubits) + "q unitaries";
+
+        qf_test::check(max_error < 1e-12, name + " are unitary, largest error " + std::to_string(max_error));
+        qf_test::check(std::abs(mean_norm - 1.0 / dim) < 0.02, name + " have mean |U00|^2 " + std::to_string(mean_norm) + ", expected " + std::to_string(1.0 / dim));
+
+        // |tr U|^2 has variance at most 1, so the mean over N_SAMPLES is within 0.1 of 1 with a wide margin
+        qf_test::check(std::abs(mean_trace_norm - 1.0) < 0.1, name + " have mean |tr U|^2 " + std::to_string(mean_trace_norm) + ", expected 1");
+    }
+
+    return qf_test::report("test_unitary");
+}
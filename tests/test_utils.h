@@ -0,0 +1,112 @@
+#ifndef TEST_UTILS_H
+#define TEST_UTILS_H
+
+#include <utils.h>
+#include <params.h>
+#include <map>
+#include <algorithm>
+#include <sstream>
+#include <sys/wait.h>
+
+/*
+    Minimal helpers shared by the test executables in this directory. Each executable runs its checks from `main`, reports every failed
+    check, and exits non-zero if any failed. Tests run from a scratch directory of their own, see CMakeLists.txt
+*/
+
+namespace qf_test {
+
+inline int failures = 0;
+
+inline void check(bool passed, const std::string& what, std::source_location location = std::source_location::current()){
+    if (!passed){
+        failures++;
+        std::cerr << "[FAIL] " << what << " (" << location.file_name() << ":" << location.line() << ")" << std::endl;
+    }
+}
+
+/// templates shipped with the repo, holding the meta grammar every grammar is parsed with
+inline const fs::path templates_dir = QF_TEMPLATES_DIR;
+
+/// run the `qf` binary headless with `args`, returning its exit status
+inline int run_qf(const std::string& args){
+    int status = std::system((std::string(QF_BINARY) + " " + args).c_str());
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/// grammars the end-to-end tests generate from and compare run against run
+inline const std::vector<std::string> compared_grammars = {"pytket", "qiskit", "guppy", "qasm3"};
+
+/// fresh directory below the working directory, emptied if a previous run left it behind
+inline fs::path scratch_dir(const std::string& name){
+    fs::path dir = fs::current_path() / name;
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    return dir;
+}
+
+/// templates directory holding the meta grammar and a single grammar called `name`
+inline fs::path write_grammar(const std::string& name, const std::string& source){
+    fs::path dir = scratch_dir(name + "_templates");
+    fs::copy_file(templates_dir / (std::string(QuteFuzz::META_GRAMMAR_NAME) + ".qf"), dir / (std::string(QuteFuzz::META_GRAMMAR_NAME) + ".qf"));
+
+    std::ofstream(dir / (name + ".qf")) << source;
+
+    return dir;
+}
+
+inline std::string read_file(const fs::path& path){
+    std::ifstream stream(path, std::ios::binary);
+    std::ostringstream ss;
+    ss << stream.rdbuf();
+    return ss.str();
+}
+
+/// relative path -> contents of every file below `dir`
+inline std::map<std::string, std::string> read_tree(const fs::path& dir){
+    std::map<std::string, std::string> out;
+
+    for (const auto& entry : fs::recursive_directory_iterator(dir)){
+        if (entry.is_regular_file()){
+            out[fs::relative(entry.path(), dir).string()] = read_file(entry.path());
+        }
+    }
+
+    return out;
+}
+
+/// run `qf` with `args`, writing into a fresh scratch directory called `name`, and read back every file it wrote. Checks that qf exits
+/// cleanly and writes `n_programs` programs
+inline std::map<std::string, std::string> run_and_read(const std::string& name, const std::string& args, unsigned int n_programs,
+    std::source_location location = std::source_location::current())
+{
+    fs::path output_dir = scratch_dir(name);
+
+    int status = run_qf("--output-dir " + output_dir.string() + " " + args);
+    check(status == 0, name + " exits cleanly", location);
+
+    std::map<std::string, std::string> tree = read_tree(output_dir);
+
+    unsigned int n_written = std::count_if(tree.begin(), tree.end(), [](const auto& file){
+        return fs::path(file.first).filename().string().starts_with("prog");
+    });
+
+    check(n_written == n_programs, name + " writes " + std::to_string(n_programs) + " programs, wrote " + std::to_string(n_written), location);
+
+    return tree;
+}
+
+inline int report(const std::string& test_name){
+    if (failures){
+        std::cerr << test_name << ": " << failures << " check(s) failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << test_name << ": passed" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+}
+
+#define CHECK(cond) qf_test::check((cond), #cond)
+
+#endif
@@ -0,0 +1,55 @@
+#include "test_utils.h"
+#include <cmath>
+
+/*
+    Branches are picked in proportion to their `@` weights. A group is a term of the branch it sits in, so the weight after it belongs to
+    that branch, and the weights inside it split the group's share
+*/
+
+static constexpr unsigned int N_PROGRAMS = 4000;
+
+int main(){
+    fs::path templates = qf_test::write_grammar("weights",
+        "EXTENSION = \".py\";\n"
+        "program = r circuit;\n"
+        "r = \"a\" | \"b\" @3 | (\"c\" | \"d\" @0.5) @1.5;\n"
+    );
+
+    auto programs = qf_test::run_and_read("weights_out",
+        "--grammar weights --templates " + templates.string() + " --seed 5 --count " + std::to_string(N_PROGRAMS) + "",
+        N_PROGRAMS
+    );
+
+    std::map<char, unsigned int> counts;
+
+    for (const auto& [path, program] : programs){
+        if (path.ends_with(".py")){
+            for (char c : program) counts[c]++;
+        }
+    }
+
+    const std::map<char, double> expected = {{'a', 1.0 / 5.5}, {'b', 3.0 / 5.5}, {'c', 1.0 / 5.5}, {'d', 0.5 / 5.5}};
+
+    for (const auto& [c, p] : expected){
+        double mean = N_PROGRAMS * p;
+        double sd = std::sqrt(N_PROGRAMS * p * (1.0 - p));
+
+        qf_test::check(std::abs(counts[c] - mean) < 5.0 * sd,
+            std::string(1, c) + " picked " + std::to_string(counts[c]) + " times, expected about " + std::to_string((unsigned int)mean));
+    }
+
+    // a weight that would otherwise silently replace another is rejected
+    fs::path twice = qf_test::write_grammar("weights_twice",
+        "EXTENSION = \".py\";\n"
+        "program = r circuit;\n"
+        "r = \"a\" | (\"c\" | \"d\") @2 \"e\" @3;\n"
+    );
+
+    int status = qf_test::run_qf(
+        "--grammar weights_twice --templates " + twice.string() + " --output-dir " + qf_test::scratch_dir("weights_twice_out").string() + " > /dev/null"
+    );
+
+    qf_test::check(status != 0, "a branch given two weights is a grammar error");
+
+    return qf_test::report("test_weights");
+}
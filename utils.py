@@ -126,16 +126,22 @@ class Run(ABC):
     @time_it
     def generate_tests(self, num_tests):
         """
-        Feeds fuzzer CLI to produce tests for given grammar
+        Runs the fuzzer in batch mode to produce tests for given grammar
         """
-        setup_grammar_str = f"{self.name} {ENTRY_POINT}\n"
-        seed_str = f"seed {self.seed}\n" if (self.seed is not None) else ""
-        map_elites_str = "map-elites\n" if self.map_elites else ""
-
-        input_str = setup_grammar_str + seed_str + map_elites_str
-
-        # must always come last, as entering after setting grammar and number of tests sets off
-        # the generator
-        input_str += f"{num_tests}\nquit\n"
-
-        pipe_to_process(FUZZER_EXECUTABLE, BUILD_DIR, input_str)
+        cmd = [
+            FUZZER_EXECUTABLE,
+            "--grammar",
+            self.name,
+            "--entry",
+            ENTRY_POINT,
+            "--count",
+            str(num_tests),
+        ]
+
+        if self.seed is not None:
+            cmd += ["--seed", str(self.seed)]
+
+        if self.map_elites:
+            cmd.append("--map-elites")
+
+        pipe_to_process(cmd, BUILD_DIR, "")